@@ -311,10 +311,37 @@ filter_data(lua_State *L, int fd, uint8_t * buffer, int size) {
 	int ret = filter_data_(L, fd, buffer, size);
 	// buffer is the data of socket message, it malloc at socket_server.c : function forward_message .
 	// it should be free before return,
-	skynet_free(buffer);
+	skynet_socket_free_data(buffer, size);
 	return ret;
 }
 
+// All the packages in a batch message are pushed into the queue
+static int
+filter_batch(lua_State *L, struct skynet_socket_message *message) {
+	int n = message->ud;
+	int i;
+	for (i=1;i<=n;i++) {
+		struct skynet_socket_message *sm = &message[i];
+		int ret = filter_data(L, sm->id, (uint8_t *)sm->buffer, sm->ud);
+		if (ret == 5) {
+			// queue, TYPE_DATA, fd, msg, size
+			int fd = lua_tointeger(L, -3);
+			void * msg = lua_touserdata(L, -2);
+			int size = lua_tointeger(L, -1);
+			lua_settop(L, 1);
+			push_data(L, fd, msg, size, 0);
+		} else {
+			lua_settop(L, 1);
+		}
+	}
+	struct queue *q = lua_touserdata(L, 1);
+	if (q == NULL || q->head == q->tail) {
+		return 1;
+	}
+	lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
+	return 2;
+}
+
 static void
 pushstring(lua_State *L, const char * msg, int size) {
 	if (msg) {
@@ -338,6 +365,10 @@ static int
 lfilter(lua_State *L) {
 	struct skynet_socket_message *message = lua_touserdata(L,2);
 	int size = luaL_checkinteger(L,3);
+	if (message->type == SKYNET_SOCKET_TYPE_BATCH) {
+		lua_settop(L, 1);
+		return filter_batch(L, message);
+	}
 	char * buffer = message->buffer;
 	if (buffer == NULL) {
 		buffer = (char *)(message+1);
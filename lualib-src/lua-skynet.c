@@ -98,6 +98,7 @@ lcallback(lua_State *L) {
 	} else {
 		skynet_callback(context, gL, _cb);
 	}
+	skynet_callback_forward(context, forward);
 
 	return 0;
 }
@@ -173,6 +174,17 @@ lintcommand(lua_State *L) {
 	if (result) {
 		char *endptr = NULL; 
 		lua_Integer r = strtoll(result, &endptr, 0);
+		if (endptr != NULL && *endptr == ' ' && endptr != result) {
+			// two integers, such as "session id" of TIMER
+			const char * second = endptr + 1;
+			lua_Integer r2 = strtoll(second, &endptr, 0);
+			if (endptr != second && *endptr == '\0') {
+				lua_pushinteger(L, r);
+				lua_pushinteger(L, r2);
+				return 2;
+			}
+			return luaL_error(L, "Invalid result %s", result);
+		}
 		if (endptr == NULL || *endptr != '\0') {
 			// may be real number
 			double n = strtod(result, &endptr);
@@ -261,6 +273,12 @@ send_message(lua_State *L, int source, int idx_type) {
 		luaL_error(L, "invalid param %s", lua_typename(L, lua_type(L,idx_type+2)));
 	}
 	if (session < 0) {
+		if (session == -2) {
+			// the queue of destination is full, see skynet.limit
+			lua_pushnil(L);
+			lua_pushliteral(L, "overload");
+			return 2;
+		}
 		// send to invalid address
 		// todo: maybe throw an error would be better
 		return 0;
@@ -283,6 +301,80 @@ lsend(lua_State *L) {
 	return send_message(L, 0, 2);
 }
 
+/*
+	table addresses (integer)
+	integer type
+	string message
+	 lightuserdata message_ptr
+	 integer len
+ */
+#define MULTI_STACK 256
+
+static int
+lsend_multi(lua_State *L) {
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	void * msg = NULL;
+	size_t len = 0;
+	int isnum;
+	int mtype = lua_type(L,3);
+	switch (mtype) {
+	case LUA_TSTRING:
+		msg = (void *)lua_tolstring(L,3,&len);
+		if (len == 0) {
+			msg = NULL;
+		}
+		break;
+	case LUA_TLIGHTUSERDATA: {
+		msg = lua_touserdata(L,3);
+		len = (size_t)lua_tointegerx(L,4,&isnum);
+		if (!isnum) {
+			// the message is owned by send_multi, free it before raising the error
+			skynet_free(msg);
+			return luaL_error(L, "Invalid message size");
+		}
+		break;
+	}
+	default:
+		return luaL_error(L, "invalid param %s", lua_typename(L, mtype));
+	}
+	int type = (int)lua_tointegerx(L, 2, &isnum);
+	if (!isnum || !lua_istable(L, 1)) {
+		if (mtype == LUA_TLIGHTUSERDATA) {
+			skynet_free(msg);
+		}
+		// raise the error
+		luaL_checktype(L, 1, LUA_TTABLE);
+		luaL_checkinteger(L, 2);
+	}
+	if (mtype == LUA_TLIGHTUSERDATA) {
+		type |= PTYPE_TAG_DONTCOPY;
+	}
+	int n = lua_rawlen(L, 1);
+	uint32_t tmp[MULTI_STACK];
+	uint32_t *dest = tmp;
+	if (n > MULTI_STACK) {
+		dest = lua_newuserdata(L, n * sizeof(uint32_t));
+	}
+	int i;
+	for (i=0;i<n;i++) {
+		lua_rawgeti(L, 1, i+1);
+		dest[i] = (uint32_t)lua_tointegerx(L, -1, &isnum);
+		if (!isnum) {
+			if (mtype == LUA_TLIGHTUSERDATA) {
+				skynet_free(msg);
+			}
+			return luaL_error(L, "Invalid address %s at %d", luaL_tolstring(L, -1, NULL), i+1);
+		}
+		lua_pop(L, 1);
+	}
+	int count = skynet_send_multi(context, 0, dest, n, type, msg, len);
+	if (count < 0) {
+		return luaL_error(L, "send_multi failed");
+	}
+	lua_pushinteger(L, count);
+	return 1;
+}
+
 /*
 	uint32 address
 	 string address
@@ -390,6 +482,7 @@ luaopen_skynet_core(lua_State *L) {
 
 	luaL_Reg l[] = {
 		{ "send" , lsend },
+		{ "send_multi", lsend_multi },
 		{ "genid", lgenid },
 		{ "redirect", lredirect },
 		{ "command" , lcommand },
@@ -42,7 +42,7 @@ lfreepool(lua_State *L) {
 	for (i=0;i<sz;i++) {
 		struct buffer_node *node = &pool[i];
 		if (node->msg) {
-			skynet_free(node->msg);
+			skynet_socket_free_data(node->msg, node->sz);
 			node->msg = NULL;
 		}
 	}
@@ -156,7 +156,7 @@ return_free_node(lua_State *L, int pool, struct socket_buffer *sb) {
 	lua_rawgeti(L,pool,1);
 	free_node->next = lua_touserdata(L,-1);
 	lua_pop(L,1);
-	skynet_free(free_node->msg);
+	skynet_socket_free_data(free_node->msg, free_node->sz);
 	free_node->msg = NULL;
 
 	free_node->sz = 0;
@@ -292,11 +292,21 @@ lreadall(lua_State *L) {
 static int
 ldrop(lua_State *L) {
 	void * msg = lua_touserdata(L,1);
-	luaL_checkinteger(L,2);
-	skynet_free(msg);
+	int sz = luaL_checkinteger(L,2);
+	skynet_socket_free_data(msg, sz);
 	return 0;
 }
 
+static int
+lbufferstat(lua_State *L) {
+	uint64_t alloc, reuse, cached;
+	skynet_socket_buffer_stat(&alloc, &reuse, &cached);
+	lua_pushinteger(L, alloc);
+	lua_pushinteger(L, reuse);
+	lua_pushinteger(L, cached);
+	return 3;
+}
+
 static bool
 check_sep(struct buffer_node * node, int from, const char *sep, int seplen) {
 	for (;;) {
@@ -387,6 +397,11 @@ lunpack(lua_State *L) {
 	lua_pushinteger(L, message->type);
 	lua_pushinteger(L, message->id);
 	lua_pushinteger(L, message->ud);
+	if (message->type == SKYNET_SOCKET_TYPE_BATCH) {
+		// iterate it with nextbatch
+		lua_pushlightuserdata(L, message);
+		return 4;
+	}
 	if (message->buffer == NULL) {
 		lua_pushlstring(L, (char *)(message+1),size - sizeof(*message));
 	} else {
@@ -403,6 +418,29 @@ lunpack(lua_State *L) {
 	return 4;
 }
 
+/*
+	lightuserdata batch message
+	integer index
+	return
+		integer index
+		integer id
+		integer size
+		lightuserdata data
+ */
+static int
+lnextbatch(lua_State *L) {
+	struct skynet_socket_message *message = lua_touserdata(L,1);
+	int i = luaL_checkinteger(L,2);
+	if (message == NULL || i >= message->ud)
+		return 0;
+	struct skynet_socket_message *sm = &message[++i];
+	lua_pushinteger(L, i);
+	lua_pushinteger(L, sm->id);
+	lua_pushinteger(L, sm->ud);
+	lua_pushlightuserdata(L, sm->buffer);
+	return 4;
+}
+
 static const char *
 address_port(lua_State *L, char *tmp, const char * addr, int port_index, int *port) {
 	const char * host;
@@ -600,6 +638,15 @@ lnodelay(lua_State *L) {
 	return 0;
 }
 
+static int
+lbatch(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int enable = lua_isnoneornil(L, 2) ? 1 : lua_toboolean(L, 2);
+	skynet_socket_batch(ctx, id, enable);
+	return 0;
+}
+
 static int
 ludp(lua_State *L) {
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
@@ -688,6 +735,7 @@ luaopen_skynet_socketdriver(lua_State *L) {
 		{ "push", lpushbuffer },
 		{ "pop", lpopbuffer },
 		{ "drop", ldrop },
+		{ "bufferstat", lbufferstat },
 		{ "readall", lreadall },
 		{ "clear", lclearbuffer },
 		{ "readline", lreadline },
@@ -695,6 +743,7 @@ luaopen_skynet_socketdriver(lua_State *L) {
 		{ "header", lheader },
 
 		{ "unpack", lunpack },
+		{ "nextbatch", lnextbatch },
 		{ NULL, NULL },
 	};
 	luaL_newlib(L,l);
@@ -708,6 +757,7 @@ luaopen_skynet_socketdriver(lua_State *L) {
 		{ "bind", lbind },
 		{ "start", lstart },
 		{ "nodelay", lnodelay },
+		{ "batch", lbatch },
 		{ "udp", ludp },
 		{ "udp_connect", ludp_connect },
 		{ "udp_send", ludp_send },
@@ -104,9 +104,9 @@ function httpc.request(method, host, url, recvheader, header, content)
 		error(string.format("http connect error host:%s, port:%s, timeout:%s", hostname, port, timeout))
 		return
 	end
-	local finish
+	local finish, timer
 	if timeout then
-		skynet.timeout(timeout, function()
+		timer = skynet.timeout(timeout, function()
 			if not finish then
 				socket.shutdown(fd)	-- shutdown the socket fd, need close later.
 			end
@@ -114,6 +114,9 @@ function httpc.request(method, host, url, recvheader, header, content)
 	end
 	local ok , statuscode, body = pcall(request, fd,method, host, url, recvheader, header, content)
 	finish = true
+	if timer then
+		skynet.canceltimer(timer)
+	end
 	socket.close(fd)
 	if ok then
 		return statuscode, body
@@ -260,16 +260,16 @@ function suspend(co, result, command, param, size)
 	dispatch_error_queue()
 end
 
-function skynet.timeout(ti, func)
-	local session = c.intcommand("TIMEOUT",ti)
-	assert(session)
-	local co = co_create(func)
+local function timeout(cmd, ti, func)
+	local session, id = c.intcommand(cmd,ti)
 	assert(session_id_coroutine[session] == nil)
-	session_id_coroutine[session] = co
+	-- the coroutine is created when it fires (see raw_dispatch_message), so a cancelled timer costs none
+	session_id_coroutine[session] = func
+	return session << 32 | (id & 0xffffffff)
 end
 
-function skynet.sleep(ti)
-	local session = c.intcommand("TIMEOUT",ti)
+local function sleep(cmd, ti)
+	local session = c.intcommand(cmd,ti)
 	assert(session)
 	local succ, ret = coroutine_yield("SLEEP", session)
 	sleep_session[coroutine.running()] = nil
@@ -283,6 +283,42 @@ function skynet.sleep(ti)
 	end
 end
 
+-- ti is in centisecond (1/100 second)
+-- returns the handle of timer for skynet.canceltimer
+function skynet.timeout(ti, func)
+	return timeout("TIMER", ti, func)
+end
+
+function skynet.sleep(ti)
+	return sleep("TIMEOUT", ti)
+end
+
+-- ti is in millisecond, the resolution is the timer_tick in config (10ms by default)
+function skynet.timeout_ms(ti, func)
+	return timeout("TIMERMS", ti, func)
+end
+
+function skynet.sleep_ms(ti)
+	return sleep("TIMEOUTMS", ti)
+end
+
+-- cancel the timer of skynet.timeout (or skynet.timeout_ms), returns false if func has been called (or cancelled)
+function skynet.canceltimer(handle)
+	local session = handle >> 32
+	local func = session_id_coroutine[session]
+	if type(func) ~= "function" then
+		-- it has fired or been cancelled
+		return false
+	end
+	if c.intcommand("CANCEL", handle & 0xffffffff) == 1 then
+		session_id_coroutine[session] = nil
+	else
+		-- the response is in the message queue already, ignore it
+		session_id_coroutine[session] = "BREAK"
+	end
+	return true
+end
+
 function skynet.yield()
 	return skynet.sleep(0)
 end
@@ -358,6 +394,13 @@ function skynet.send(addr, typename, ...)
 	return c.send(addr, p.id, 0 , p.pack(...))
 end
 
+-- Send the same message to a list of addresses, the message is packed once and the local services share it.
+-- return the number of services it's sent to.
+function skynet.send_multi(addrs, typename, ...)
+	local p = proto[typename]
+	return c.send_multi(addrs, p.id, p.pack(...))
+end
+
 function skynet.rawsend(addr, typename, msg, sz)
 	local p = proto[typename]
 	return c.send(addr, p.id, 0 , msg, sz)
@@ -387,8 +430,11 @@ end
 
 function skynet.call(addr, typename, ...)
 	local p = proto[typename]
-	local session = c.send(addr, p.id , nil , p.pack(...))
+	local session, err = c.send(addr, p.id , nil , p.pack(...))
 	if session == nil then
+		if err then
+			error(string.format("call to %s failed : %s", skynet.address(addr), err))
+		end
 		error("call to invalid address " .. skynet.address(addr))
 	end
 	return p.unpack(yield_call(addr, session))
@@ -473,6 +519,10 @@ local function raw_dispatch_message(prototype, msg, sz, session, source)
 			unknown_response(session, source, msg, sz)
 		else
 			session_id_coroutine[session] = nil
+			if type(co) == "function" then
+				-- skynet.timeout
+				co = co_create(co)
+			end
 			suspend(co, coroutine_resume(co, true, msg, sz))
 		end
 	else
@@ -665,11 +715,51 @@ function skynet.stat(what)
 	return c.intcommand("STAT", what)
 end
 
+-- class : "interactive", "normal" (default) or "batch". returns the current class
+function skynet.priority(class)
+	return c.command("PRIORITY", class)
+end
+
+-- the time from send to dispatch of the messages of current service, or the whole node with "node"
+-- returns count, p50, p99, max in microsecond
+function skynet.qwait(what)
+	local r = what and c.command("QWAIT", what) or c.command("QWAIT")
+	local count, p50, p99, max = r:match "(%d+) (%d+) (%d+) (%d+)"
+	return tonumber(count), tonumber(p50), tonumber(p99), tonumber(max)
+end
+
+-- limit : max length of the message queue of current service, 0 (default) means unbounded
+-- policy : "reject" (default), "drop" (the oldest messages) or "signal" (see skynet.backpressure)
+-- With "signal" policy the message is still queued, and nothing is sent to the sender.
+-- The sender polls its skynet.backpressure counter to slow down.
+-- returns the current limit and policy
+function skynet.limit(limit, policy)
+	local r
+	if limit then
+		r = c.command("LIMIT", policy and (limit .. " " .. policy) or tostring(limit))
+	else
+		r = c.command("LIMIT")
+	end
+	local n, p = r:match "(%d+) (%a+)"
+	return tonumber(n), p
+end
+
+-- returns how many messages were sent to the services over their limit with "signal" policy, since last call
+-- It's a counter of current service, poll it (for example, before each burst of sends).
+function skynet.backpressure()
+	return c.intcommand("STAT", "backpressure")
+end
+
 function skynet.task(ret)
 	local t = 0
 	for session,co in pairs(session_id_coroutine) do
 		if ret then
-			ret[session] = debug.traceback(co)
+			if type(co) == "function" then
+				local info = debug.getinfo(co, "S")
+				ret[session] = string.format("timer %s:%d", info.short_src, info.linedefined)
+			else
+				ret[session] = debug.traceback(co)
+			end
 		end
 		t = t + 1
 	end
@@ -27,11 +27,22 @@ local function init(skynet, export)
 			local stat = {}
 			stat.task = skynet.task()
 			stat.mqlen = skynet.stat "mqlen"
+			stat.mqmem = skynet.stat "mqmem"
+			stat.mqpeak = skynet.stat "mqpeak"
+			stat.dropped = skynet.stat "dropped"
 			stat.cpu = skynet.stat "cpu"
 			stat.message = skynet.stat "message"
+			stat.turn = skynet.stat "turn"
+			stat.qwait = select(3, skynet.qwait())	-- p99
+			stat.long = skynet.stat "long"
 			skynet.ret(skynet.pack(stat))
 		end
 
+		function dbgcmd.QWAIT()
+			local count, p50, p99, max = skynet.qwait()
+			skynet.ret(skynet.pack { count = count, p50 = p50, p99 = p99, max = max })
+		end
+
 		function dbgcmd.TASK()
 			local task = {}
 			skynet.task(task)
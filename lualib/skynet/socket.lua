@@ -1,6 +1,5 @@
 local driver = require "skynet.socketdriver"
 local skynet = require "skynet"
-local skynet_core = require "skynet.core"
 local assert = assert
 
 local socket = {}	-- api
@@ -132,10 +131,19 @@ socket_message[6] = function(id, size, data, address)
 		return
 	end
 	local str = skynet.tostring(data, size)
-	skynet_core.trash(data, size)
+	driver.drop(data, size)
 	s.callback(str, address)
 end
 
+-- SKYNET_SOCKET_TYPE_BATCH = 8, the data of sockets in one poll round (see socket.batch)
+local nextbatch = driver.nextbatch
+local socket_data = socket_message[1]
+socket_message[8] = function(_, n, msg)
+	for _, id, size, data in nextbatch, msg, 0 do
+		socket_data(id, size, data)
+	end
+end
+
 local function default_warning(id, size)
 	local s = socket_pool[id]
 	if not s then
@@ -340,6 +348,8 @@ end
 socket.write = assert(driver.send)
 socket.lwrite = assert(driver.lsend)
 socket.header = assert(driver.header)
+-- socket.batch(id [, enable]) : the data of this socket in one poll round are packed into one message to the service
+socket.batch = assert(driver.batch)
 
 function socket.invalid(id)
 	return socket_pool[id] == nil
@@ -439,6 +449,9 @@ end
 socket.sendto = assert(driver.udp_send)
 socket.udp_address = assert(driver.udp_address)
 
+-- the receive buffers of all sockets : malloc count, reuse count, cached bytes
+socket.bufferstat = assert(driver.bufferstat)
+
 function socket.warning(id, callback)
 	local obj = socket_pool[id]
 	assert(obj)
@@ -10,6 +10,7 @@ local maxclient	-- max client
 local client_number = 0
 local CMD = setmetatable({}, { __gc = function() netpack.clear(queue) end })
 local nodelay = false
+local batch = false
 
 local connection = {}
 
@@ -37,6 +38,7 @@ function gateserver.start(handler)
 		local port = assert(conf.port)
 		maxclient = conf.maxclient or 1024
 		nodelay = conf.nodelay
+		batch = conf.batch
 		skynet.error(string.format("Listen on %s:%d", address, port))
 		socket = socketdriver.listen(address, port)
 		socketdriver.start(socket)
@@ -86,6 +88,10 @@ function gateserver.start(handler)
 		if nodelay then
 			socketdriver.nodelay(fd)
 		end
+		if batch then
+			-- netpack.filter pushes the packages of batch into the queue, and MSG.more dispatches them
+			socketdriver.batch(fd)
+		end
 		connection[fd] = true
 		client_number = client_number + 1
 		handler.connect(fd, msg)
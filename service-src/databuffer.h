@@ -54,7 +54,7 @@ _return_message(struct databuffer *db, struct messagepool *mp) {
 	} else {
 		db->head = m->next;
 	}
-	skynet_free(m->buffer);
+	skynet_socket_free_data(m->buffer, m->size);
 	m->buffer = NULL;
 	m->size = 0;
 	m->next = mp->freelist;
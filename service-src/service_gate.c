@@ -225,7 +225,7 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 		} else {
 			skynet_error(ctx, "Drop unknown connection %d message", message->id);
 			skynet_socket_close(ctx, message->id);
-			skynet_free(message->buffer);
+			skynet_socket_free_data(message->buffer, message->ud);
 		}
 		break;
 	}
@@ -391,6 +391,8 @@ gate_init(struct gate *g , struct skynet_context * ctx, char * parm) {
 	g->header_size = header=='S' ? 2 : 4;
 
 	skynet_callback(ctx,g,_cb);
+	// the client messages are kept and sent by the socket
+	skynet_callback_forward(ctx, 1);
 
 	return start_listen(g,binding);
 }
@@ -664,7 +664,7 @@ mainloop(struct skynet_context * context, void * ud, int type, int session, uint
 		switch(message->type) {
 		case SKYNET_SOCKET_TYPE_DATA:
 			push_socket_data(h, message);
-			skynet_free(message->buffer);
+			skynet_socket_free_data(message->buffer, message->ud);
 			break;
 		case SKYNET_SOCKET_TYPE_ERROR:
 		case SKYNET_SOCKET_TYPE_CLOSE: {
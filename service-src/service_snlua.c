@@ -1,4 +1,5 @@
 #include "skynet.h"
+#include "atomic.h"
 
 #include <lua.h>
 #include <lualib.h>
@@ -17,6 +18,8 @@ struct snlua {
 	size_t mem;
 	size_t mem_report;
 	size_t mem_limit;
+	lua_State * activeL;	// the running coroutine
+	int trap;	// for the traceback of a long dispatch. 0 : none, 1 : setting the hook, -1 : the hook is set
 };
 
 // LUA_CACHELIB may defined in patched lua for shared proto
@@ -57,6 +60,127 @@ traceback (lua_State *L) {
 	return 1;
 }
 
+// The monitor thread sets a hook on the running coroutine (signal 2), the hook logs the traceback of it.
+// coroutine.resume and coroutine.wrap are replaced to track the running coroutine, and move the hook to it.
+
+static void
+traceback_hook(lua_State *L, lua_Debug *ar) {
+	void *ud = NULL;
+	lua_getallocf(L, &ud);
+	struct snlua *l = (struct snlua *)ud;
+
+	lua_sethook(L, NULL, 0, 0);
+	if (ATOM_LOAD(&l->trap)) {
+		ATOM_STORE(&l->trap, 0);
+		luaL_traceback(L, L, "Long dispatch", 0);
+		skynet_error(l->ctx, "%s", lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
+}
+
+static void
+switchL(lua_State *L, struct snlua *l) {
+	l->activeL = L;
+	if (ATOM_LOAD(&l->trap)) {
+		lua_sethook(L, traceback_hook, LUA_MASKCOUNT, 1);
+	}
+}
+
+static int
+lua_resumeX(lua_State *L, lua_State *from, int nargs) {
+	void *ud = NULL;
+	lua_getallocf(L, &ud);
+	struct snlua *l = (struct snlua *)ud;
+	switchL(L, l);
+	int err = lua_resume(L, from, nargs);
+	if (ATOM_LOAD(&l->trap)) {
+		// wait for lua_sethook in the monitor thread (l->trap == -1)
+		while (ATOM_LOAD(&l->trap) > 0) {}
+	}
+	switchL(from, l);
+	return err;
+}
+
+// The same as auxresume in lcorolib.c, but calls lua_resumeX
+static int
+auxresume(lua_State *L, lua_State *co, int narg) {
+	int status;
+	if (!lua_checkstack(co, narg)) {
+		lua_pushliteral(L, "too many arguments to resume");
+		return -1;	/* error flag */
+	}
+	if (lua_status(co) == LUA_OK && lua_gettop(co) == 0) {
+		lua_pushliteral(L, "cannot resume dead coroutine");
+		return -1;	/* error flag */
+	}
+	lua_xmove(L, co, narg);
+	status = lua_resumeX(co, L, narg);
+	if (status == LUA_OK || status == LUA_YIELD) {
+		int nres = lua_gettop(co);
+		if (!lua_checkstack(L, nres + 1)) {
+			lua_pop(co, nres);	/* remove results anyway */
+			lua_pushliteral(L, "too many results to resume");
+			return -1;	/* error flag */
+		}
+		lua_xmove(co, L, nres);	/* move yielded values */
+		return nres;
+	} else {
+		lua_xmove(co, L, 1);	/* move error message */
+		return -1;	/* error flag */
+	}
+}
+
+static int
+lresume(lua_State *L) {
+	lua_State *co = lua_tothread(L, 1);
+	luaL_argcheck(L, co, 1, "thread expected");
+	int r = auxresume(L, co, lua_gettop(L) - 1);
+	if (r < 0) {
+		lua_pushboolean(L, 0);
+		lua_insert(L, -2);
+		return 2;	/* return false + error message */
+	} else {
+		lua_pushboolean(L, 1);
+		lua_insert(L, -(r + 1));
+		return r + 1;	/* return true + 'resume' returns */
+	}
+}
+
+static int
+lauxwrap(lua_State *L) {
+	lua_State *co = lua_tothread(L, lua_upvalueindex(1));
+	int r = auxresume(L, co, lua_gettop(L));
+	if (r < 0) {
+		if (lua_type(L, -1) == LUA_TSTRING) {	/* error object is a string? */
+			luaL_where(L, 1);	/* add extra info */
+			lua_insert(L, -2);
+			lua_concat(L, 2);
+		}
+		return lua_error(L);	/* propagate error */
+	}
+	return r;
+}
+
+static int
+lwrap(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	lua_State *NL = lua_newthread(L);
+	lua_pushvalue(L, 1);	/* move function to top */
+	lua_xmove(L, NL, 1);	/* move function from L to NL */
+	lua_pushcclosure(L, lauxwrap, 1);
+	return 1;
+}
+
+static void
+replace_coroutine(lua_State *L) {
+	lua_getglobal(L, "coroutine");
+	lua_pushcfunction(L, lresume);
+	lua_setfield(L, -2, "resume");
+	lua_pushcfunction(L, lwrap);
+	lua_setfield(L, -2, "wrap");
+	lua_pop(L, 1);
+}
+
 static void
 report_launcher_error(struct skynet_context *ctx) {
 	// sizeof "ERROR" == 5
@@ -80,6 +204,8 @@ init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t s
 	lua_pushboolean(L, 1);  /* signal for libraries to ignore env. vars. */
 	lua_setfield(L, LUA_REGISTRYINDEX, "LUA_NOENV");
 	luaL_openlibs(L);
+	// before skynet.profile gets coroutine.resume
+	replace_coroutine(L);
 	lua_pushlightuserdata(L, ctx);
 	lua_setfield(L, LUA_REGISTRYINDEX, "skynet_context");
 	luaL_requiref(L, "skynet.codecache", codecache , 0);
@@ -184,6 +310,8 @@ snlua_create(void) {
 	l->mem_report = MEMORY_WARNING_REPORT;
 	l->mem_limit = 0;
 	l->L = lua_newstate(lalloc, l);
+	l->activeL = l->L;
+	l->trap = 0;
 	return l;
 }
 
@@ -203,5 +331,11 @@ snlua_signal(struct snlua *l, int signal) {
 #endif
 	} else if (signal == 1) {
 		skynet_error(l->ctx, "Current Memory %.3fK", (float)l->mem / 1024);
+	} else if (signal == 2) {
+		// log the traceback of the running coroutine, only one thread can set the trap (0 -> 1)
+		if (ATOM_CAS(&l->trap, 0, 1)) {
+			lua_sethook(l->activeL, traceback_hook, LUA_MASKCOUNT, 1);
+			ATOM_CAS(&l->trap, 1, -1);
+		}
 	}
 }
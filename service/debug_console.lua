@@ -158,6 +158,10 @@ function COMMAND.help()
 		shrtbl = "Show shared short string table info",
 		ping = "ping address",
 		call = "call address ...",
+		wakeup = "Show worker wakeup latency (microsecond)",
+		qwait = "qwait [address] : Show queue wait of a service or the whole node (microsecond)",
+		timerlag = "Show the lag of timer thread (microsecond), max is reset",
+		long = "List the services have long dispatch (see monitor_threshold in config)",
 	}
 end
 
@@ -335,6 +339,37 @@ function COMMAND.shrtbl()
 	return { n = n, total = total, longest = longest, space = space }
 end
 
+function COMMAND.wakeup()
+	local count, p50, p99, max = core.command("WAKEUP"):match "(%d+) (%d+) (%d+) (%d+)"
+	return { count = tonumber(count), p50 = tonumber(p50), p99 = tonumber(p99), max = tonumber(max) }
+end
+
+function COMMAND.timerlag()
+	local last, max, stalls, jumps = core.command("TIMERLAG"):match "(%d+) (%d+) (%d+) (%d+)"
+	return { last = tonumber(last), max = tonumber(max), stalls = tonumber(stalls), jumps = tonumber(jumps) }
+end
+
+function COMMAND.long()
+	-- don't call the services, they may be stuck
+	local list = skynet.call(".launcher", "lua", "LIST")
+	local ret = {}
+	for addr, name in pairs(list) do
+		local n = tonumber(core.command("LONG", addr))
+		if n and n > 0 then
+			ret[addr] = string.format("%d\t%s", n, name)
+		end
+	end
+	return ret
+end
+
+function COMMAND.qwait(address)
+	if address then
+		return skynet.call(adjust_address(address), "debug", "QWAIT")
+	end
+	local count, p50, p99, max = core.command("QWAIT", "node"):match "(%d+) (%d+) (%d+) (%d+)"
+	return { count = tonumber(count), p50 = tonumber(p50), p99 = tonumber(p99), max = tonumber(max) }
+end
+
 function COMMAND.ping(address)
 	address = adjust_address(address)
 	local ti = skynet.now()
@@ -10,5 +10,10 @@
 #define ATOM_ADD(ptr,n) __sync_add_and_fetch(ptr, n)
 #define ATOM_SUB(ptr,n) __sync_sub_and_fetch(ptr, n)
 #define ATOM_AND(ptr,n) __sync_and_and_fetch(ptr, n)
+#define ATOM_SWAP(ptr, nval) __atomic_exchange_n(ptr, nval, __ATOMIC_SEQ_CST)
+#define ATOM_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define ATOM_STORE(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_SEQ_CST)
+#define ATOM_LOAD_ACQ(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define ATOM_STORE_REL(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
 
 #endif
@@ -30,12 +30,17 @@ void skynet_error(struct skynet_context * context, const char *msg, ...);
 const char * skynet_command(struct skynet_context * context, const char * cmd , const char * parm);
 uint32_t skynet_queryname(struct skynet_context * context, const char * name);
 int skynet_send(struct skynet_context * context, uint32_t source, uint32_t destination , int type, int session, void * msg, size_t sz);
+// Send one message (session 0) to n services, the local ones share one copy of the payload, it's freed after the last one dispatches it.
+// So the receivers can't reserve (forward) the message. return the number of services it's sent to.
+int skynet_send_multi(struct skynet_context * context, uint32_t source, const uint32_t *destination, int n, int type, void * msg, size_t sz);
 int skynet_sendname(struct skynet_context * context, uint32_t source, const char * destination , int type, int session, void * msg, size_t sz);
 
 int skynet_isremote(struct skynet_context *, uint32_t handle, int * harbor);
 
 typedef int (*skynet_cb)(struct skynet_context * context, void *ud, int type, int session, uint32_t source , const void * msg, size_t sz);
 void skynet_callback(struct skynet_context * context, void *ud, skynet_cb cb);
+// The callback may keep the message (return 1), so the service can't share the payload of skynet_send_multi.
+void skynet_callback_forward(struct skynet_context * context, int forward);
 
 uint32_t skynet_current_handle(void);
 uint64_t skynet_now(void);
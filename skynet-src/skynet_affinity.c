@@ -0,0 +1,127 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "skynet_affinity.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+int
+skynet_cpuset_parse(struct skynet_cpuset *set, const char *list) {
+	set->n = 0;
+	if (list == NULL)
+		return 0;
+	const char *p = list;
+	while (*p) {
+		while (isspace((unsigned char)*p) || *p == ',')
+			++p;
+		if (*p == '\0')
+			break;
+		if (!isdigit((unsigned char)*p))
+			return -1;
+		char *end;
+		int from = strtol(p, &end, 10);
+		int to = from;
+		p = end;
+		if (*p == '-') {
+			++p;
+			if (!isdigit((unsigned char)*p))
+				return -1;
+			to = strtol(p, &end, 10);
+			p = end;
+		}
+		if (to < from)
+			return -1;
+		int i;
+		for (i=from;i<=to;i++) {
+			if (set->n >= AFFINITY_MAX_CPU)
+				return -1;
+			set->cpu[set->n++] = i;
+		}
+	}
+	return set->n;
+}
+
+#ifdef __linux__
+
+int
+skynet_cpuset_bind(pthread_attr_t *attr, const struct skynet_cpuset *set, int index) {
+	if (set->n == 0)
+		return 0;
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	if (index >= 0) {
+		CPU_SET(set->cpu[index % set->n], &cpus);
+	} else {
+		int i;
+		for (i=0;i<set->n;i++) {
+			CPU_SET(set->cpu[i], &cpus);
+		}
+	}
+	return pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
+}
+
+// Use the syscall directly, so we don't depend on libnuma.
+
+#define MPOL_DEFAULT 0
+#define MPOL_INTERLEAVE 3
+
+int
+skynet_numa_bind(int policy) {
+	if (policy == NUMA_POLICY_INTERLEAVE) {
+		// the kernel takes the intersection with the allowed nodes
+		unsigned long mask = ~0UL;
+		return syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, &mask, sizeof(mask) * 8);
+	}
+	return syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+}
+
+#else
+
+int
+skynet_cpuset_bind(pthread_attr_t *attr, const struct skynet_cpuset *set, int index) {
+	// no thread affinity api
+	return set->n == 0 ? 0 : -1;
+}
+
+int
+skynet_numa_bind(int policy) {
+	return policy == NUMA_POLICY_DEFAULT ? 0 : -1;
+}
+
+#endif
+
+const char *
+skynet_cpuset_tostring(const struct skynet_cpuset *set, int index, char *buf, int sz) {
+	if (set->n == 0) {
+		snprintf(buf, sz, "any");
+	} else if (index >= 0) {
+		snprintf(buf, sz, "%d", set->cpu[index % set->n]);
+	} else {
+		int i, len = 0;
+		buf[0] = '\0';
+		for (i=0;i<set->n && len < sz;i++) {
+			len += snprintf(buf + len, sz - len, i == 0 ? "%d" : ",%d", set->cpu[i]);
+		}
+	}
+	return buf;
+}
+
+int
+skynet_numa_policy(const char *name) {
+	if (name == NULL || strcmp(name, "default") == 0 || strcmp(name, "local") == 0)
+		return NUMA_POLICY_DEFAULT;
+	if (strcmp(name, "interleave") == 0)
+		return NUMA_POLICY_INTERLEAVE;
+	return -1;
+}
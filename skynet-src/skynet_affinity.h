@@ -0,0 +1,28 @@
+#ifndef SKYNET_AFFINITY_H
+#define SKYNET_AFFINITY_H
+
+#include <pthread.h>
+
+#define AFFINITY_MAX_CPU 1024
+
+struct skynet_cpuset {
+	int n;
+	int cpu[AFFINITY_MAX_CPU];
+};
+
+#define NUMA_POLICY_DEFAULT 0	// allocate on the node of the thread who touches it first
+#define NUMA_POLICY_INTERLEAVE 1	// interleave the shared memory (services and messages) on all the nodes
+
+// parse a cpu list such as "0-7,16,18-19", return the number of cpus, 0 for empty (no affinity), -1 for error
+int skynet_cpuset_parse(struct skynet_cpuset *set, const char *list);
+// index >= 0 binds to one cpu in the set (round robin), index < 0 binds to the whole set. return 0 for success
+int skynet_cpuset_bind(pthread_attr_t *attr, const struct skynet_cpuset *set, int index);
+// the string of the cpus which index binds to, for log
+const char * skynet_cpuset_tostring(const struct skynet_cpuset *set, int index, char *buf, int sz);
+
+// return -1 for invalid policy name
+int skynet_numa_policy(const char *name);
+// set the memory policy of current thread, the threads created later inherit it. return 0 for success
+int skynet_numa_bind(int policy);
+
+#endif
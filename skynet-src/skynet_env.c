@@ -1,47 +1,124 @@
 #include "skynet.h"
 #include "skynet_env.h"
 #include "spinlock.h"
-
-#include <lua.h>
-#include <lauxlib.h>
+#include "atomic.h"
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
+// An env can't be changed once it's set, so the entries are immutable and the readers don't need a lock.
+// skynet_setenv publishes a new entry into the free slot, or a new (copied) table when the table is half full.
+// The old tables are kept, because the readers may still use them. Their total size is less than the current one.
+
+#define DEFAULT_ENV_SIZE 64
+
+struct env_entry {
+	uint32_t hash;
+	const char *key;
+	const char *value;
+};
+
+struct env_table {
+	struct env_table *prev;	// the old one
+	int size;
+	int count;
+	struct env_entry * slot[];
+};
+
 struct skynet_env {
-	struct spinlock lock;
-	lua_State *L;
+	struct spinlock lock;	// for writers
+	struct env_table *table;
 };
 
 static struct skynet_env *E = NULL;
 
-const char * 
-skynet_getenv(const char *key) {
-	SPIN_LOCK(E)
+static uint32_t
+env_hash(const char *key) {
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	const unsigned char *p = (const unsigned char *)key;
+	while (*p) {
+		h ^= *p++;
+		h *= 16777619u;
+	}
+	return h;
+}
 
-	lua_State *L = E->L;
-	
-	lua_getglobal(L, key);
-	const char * result = lua_tostring(L, -1);
-	lua_pop(L, 1);
+static struct env_table *
+table_new(int size) {
+	struct env_table *t = skynet_malloc(sizeof(*t) + size * sizeof(struct env_entry *));
+	t->prev = NULL;
+	t->size = size;
+	t->count = 0;
+	memset(t->slot, 0, size * sizeof(struct env_entry *));
+	return t;
+}
 
-	SPIN_UNLOCK(E)
+static struct env_entry *
+table_find(struct env_table *t, const char *key, uint32_t hash) {
+	int mask = t->size - 1;
+	int i = hash & mask;
+	struct env_entry *e;
+	while ((e = ATOM_LOAD_ACQ(&t->slot[i]))) {
+		if (e->hash == hash && strcmp(e->key, key) == 0) {
+			return e;
+		}
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
 
-	fprintf(stderr, "skynet_getenv %s = %s\n", key, result);
-	return result;
+static void
+table_insert(struct env_table *t, struct env_entry *e) {
+	int mask = t->size - 1;
+	int i = e->hash & mask;
+	while (t->slot[i]) {
+		i = (i + 1) & mask;
+	}
+	ATOM_STORE_REL(&t->slot[i], e);
+	++t->count;
 }
 
-void 
+const char *
+skynet_getenv(const char *key) {
+	struct env_table *t = ATOM_LOAD_ACQ(&E->table);
+	struct env_entry *e = table_find(t, key, env_hash(key));
+	return e ? e->value : NULL;
+}
+
+void
 skynet_setenv(const char *key, const char *value) {
+	size_t ksz = strlen(key) + 1;
+	size_t vsz = strlen(value) + 1;
+	// the key and the value are in the same block
+	struct env_entry *e = skynet_malloc(sizeof(*e) + ksz + vsz);
+	char *k = (char *)(e + 1);
+	memcpy(k, key, ksz);
+	memcpy(k + ksz, value, vsz);
+	e->hash = env_hash(key);
+	e->key = k;
+	e->value = k + ksz;
+
 	SPIN_LOCK(E)
-	
-	// fprintf(stderr, "skynet_setenv %s = %s\n", key, value);
-	lua_State *L = E->L;
-	lua_getglobal(L, key);
-	assert(lua_isnil(L, -1));
-	lua_pop(L,1);
-	lua_pushstring(L,value);
-	lua_setglobal(L,key);
+
+	struct env_table *t = E->table;
+	assert(table_find(t, key, e->hash) == NULL);
+	if ((t->count + 1) * 2 > t->size) {
+		struct env_table *nt = table_new(t->size * 2);
+		int i;
+		for (i=0;i<t->size;i++) {
+			if (t->slot[i]) {
+				table_insert(nt, t->slot[i]);
+			}
+		}
+		nt->prev = t;
+		table_insert(nt, e);
+		ATOM_STORE_REL(&E->table, nt);
+	} else {
+		table_insert(t, e);
+	}
 
 	SPIN_UNLOCK(E)
 }
@@ -50,5 +127,5 @@ void
 skynet_env_init() {
 	E = skynet_malloc(sizeof(*E));
 	SPIN_INIT(E)
-	E->L = luaL_newstate();
+	E->table = table_new(DEFAULT_ENV_SIZE);
 }
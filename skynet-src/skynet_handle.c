@@ -3,33 +3,243 @@
 #include "skynet_handle.h"
 #include "skynet_server.h"
 #include "rwlock.h"
+#include "spinlock.h"
+#include "atomic.h"
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 #include <string.h>
 
 #define DEFAULT_SLOT_SIZE 4
 #define MAX_SLOT_SIZE 0x40000000
 
+// The names are indexed by two hash tables : by name for findname, and by handle for retire.
 struct handle_name {
+	struct handle_name *next;	// in the bucket of name
+	struct handle_name **prev;
+	struct handle_name *next_handle;	// in the bucket of handle
 	char * name;
+	uint32_t hash;
 	uint32_t handle;
 };
 
+#define DEFAULT_NAME_BUCKET 16
+
+// Each thread caches the results of findname (including not found), the cache is valid until the names change.
+#define NAME_CACHE_SIZE 64
+#define NAME_CACHE_LENGTH 32	// longer names are not cached
+
+struct name_cache {
+	uint64_t generation;	// 0 : empty
+	uint32_t hash;
+	uint32_t handle;
+	char name[NAME_CACHE_LENGTH];
+};
+
+// The slot array is replaced as a whole when it grows, so skynet_handle_grab can read it without lock.
+struct handle_slot {
+	int size;
+	struct skynet_context * ctx[];
+};
+
+// skynet_handle_grab announces the epoch when it enters, 0 means the reader is out.
+// A reader record is created for each thread at the first grab, and never freed.
+struct handle_reader {
+	struct handle_reader *next;
+	uint64_t epoch;
+};
+
+// The memory (old slot arrays and deleted contexts) unlinked at epoch,
+// it can be freed when all the readers entered at or before the epoch leave.
+struct handle_retired {
+	struct handle_retired *next;
+	void *ptr;
+	uint64_t epoch;
+};
+
 struct handle_storage {
-	struct rwlock lock;
+	struct rwlock lock;	// for writers (and names)
 
 	uint32_t harbor;
 	uint32_t handle_index;
-	int slot_size;
-	struct skynet_context ** slot;
+	struct handle_slot * slot;
 	
-	int name_cap;
+	int name_bucket;
 	int name_count;
-	struct handle_name *name;
+	struct handle_name **name;
+	struct handle_name **name_handle;
+	uint64_t name_generation;	// increase when the names change
+
+	uint64_t epoch;
+	struct handle_reader *reader;
+	struct spinlock lock_retired;
+	struct handle_retired *retired;
 };
 
 static struct handle_storage *H = NULL;
+static __thread struct handle_reader *READER = NULL;
+static __thread struct name_cache NAME_CACHE[NAME_CACHE_SIZE];
+
+static struct handle_slot *
+slot_new(int size) {
+	struct handle_slot *slot = skynet_malloc(sizeof(*slot) + size * sizeof(struct skynet_context *));
+	slot->size = size;
+	memset(slot->ctx, 0, size * sizeof(struct skynet_context *));
+	return slot;
+}
+
+static struct handle_reader *
+reader_enter(struct handle_storage *s) {
+	struct handle_reader *r = READER;
+	if (r == NULL) {
+		r = skynet_malloc(sizeof(*r));
+		r->epoch = 0;
+		do {
+			r->next = ATOM_LOAD(&s->reader);
+		} while (!ATOM_CAS_POINTER(&s->reader, r->next, r));
+		READER = r;
+	}
+	// seq_cst : the epoch is announced before reading the slot
+	ATOM_STORE(&r->epoch, ATOM_LOAD(&s->epoch));
+	return r;
+}
+
+static inline void
+reader_leave(struct handle_reader *r) {
+	ATOM_STORE_REL(&r->epoch, 0);
+}
+
+// with lock_retired
+static void
+reclaim(struct handle_storage *s) {
+	uint64_t min = UINT64_MAX;
+	struct handle_reader *r;
+	for (r = ATOM_LOAD(&s->reader); r; r = r->next) {
+		uint64_t e = ATOM_LOAD(&r->epoch);
+		if (e != 0 && e < min) {
+			min = e;
+		}
+	}
+	struct handle_retired **prev = &s->retired;
+	struct handle_retired *node;
+	while ((node = *prev)) {
+		if (node->epoch < min) {
+			*prev = node->next;
+			skynet_free(node->ptr);
+			skynet_free(node);
+		} else {
+			prev = &node->next;
+		}
+	}
+}
+
+static void
+retire_memory(struct handle_storage *s, void *ptr) {
+	struct handle_retired *node = skynet_malloc(sizeof(*node));
+	node->ptr = ptr;
+	spinlock_lock(&s->lock_retired);
+	// it's unlinked before the epoch moves, the readers enter after that can't see it
+	node->epoch = ATOM_FINC(&s->epoch);
+	node->next = s->retired;
+	s->retired = node;
+	reclaim(s);
+	spinlock_unlock(&s->lock_retired);
+}
+
+void
+skynet_handle_free(void *ptr) {
+	retire_memory(H, ptr);
+}
+
+static uint32_t
+name_hash(const char *name) {
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	const unsigned char *p = (const unsigned char *)name;
+	while (*p) {
+		h ^= *p++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// with lock
+static struct handle_name *
+find_name(struct handle_storage *s, const char *name, uint32_t hash) {
+	struct handle_name *n = s->name[hash & (s->name_bucket - 1)];
+	while (n) {
+		if (n->hash == hash && strcmp(n->name, name) == 0) {
+			return n;
+		}
+		n = n->next;
+	}
+	return NULL;
+}
+
+static void
+link_name(struct handle_storage *s, struct handle_name *n) {
+	struct handle_name **bucket = &s->name[n->hash & (s->name_bucket - 1)];
+	n->next = *bucket;
+	if (n->next) {
+		n->next->prev = &n->next;
+	}
+	n->prev = bucket;
+	*bucket = n;
+	bucket = &s->name_handle[n->handle & (s->name_bucket - 1)];
+	n->next_handle = *bucket;
+	*bucket = n;
+}
+
+static void
+expand_name(struct handle_storage *s) {
+	struct handle_name *all = NULL;
+	int i;
+	for (i=0;i<s->name_bucket;i++) {
+		struct handle_name *n = s->name[i];
+		while (n) {
+			struct handle_name *next = n->next;
+			n->next = all;
+			all = n;
+			n = next;
+		}
+	}
+	skynet_free(s->name);
+	skynet_free(s->name_handle);
+	s->name_bucket *= 2;
+	assert(s->name_bucket <= MAX_SLOT_SIZE);
+	s->name = skynet_malloc(s->name_bucket * sizeof(struct handle_name *));
+	memset(s->name, 0, s->name_bucket * sizeof(struct handle_name *));
+	s->name_handle = skynet_malloc(s->name_bucket * sizeof(struct handle_name *));
+	memset(s->name_handle, 0, s->name_bucket * sizeof(struct handle_name *));
+	while (all) {
+		struct handle_name *next = all->next;
+		link_name(s, all);
+		all = next;
+	}
+}
+
+// with write lock, it costs O(names of the handle)
+static void
+remove_names(struct handle_storage *s, uint32_t handle) {
+	struct handle_name **pn = &s->name_handle[handle & (s->name_bucket - 1)];
+	struct handle_name *n;
+	while ((n = *pn)) {
+		if (n->handle == handle) {
+			*pn = n->next_handle;
+			*n->prev = n->next;
+			if (n->next) {
+				n->next->prev = n->prev;
+			}
+			skynet_free(n->name);
+			skynet_free(n);
+			--s->name_count;
+			ATOM_INC(&s->name_generation);
+		} else {
+			pn = &n->next_handle;
+		}
+	}
+}
 
 uint32_t
 skynet_handle_register(struct skynet_context *ctx) {
@@ -38,12 +248,13 @@ skynet_handle_register(struct skynet_context *ctx) {
 	rwlock_wlock(&s->lock);
 	
 	for (;;) {
+		struct handle_slot *slot = s->slot;
 		int i;
-		for (i=0;i<s->slot_size;i++) {
+		for (i=0;i<slot->size;i++) {
 			uint32_t handle = (i+s->handle_index) & HANDLE_MASK;
-			int hash = handle & (s->slot_size-1);
-			if (s->slot[hash] == NULL) {
-				s->slot[hash] = ctx;
+			int hash = handle & (slot->size-1);
+			if (slot->ctx[hash] == NULL) {
+				ATOM_STORE_REL(&slot->ctx[hash], ctx);
 				s->handle_index = handle + 1;
 
 				rwlock_wunlock(&s->lock);
@@ -52,17 +263,16 @@ skynet_handle_register(struct skynet_context *ctx) {
 				return handle;
 			}
 		}
-		assert((s->slot_size*2 - 1) <= HANDLE_MASK);
-		struct skynet_context ** new_slot = skynet_malloc(s->slot_size * 2 * sizeof(struct skynet_context *));
-		memset(new_slot, 0, s->slot_size * 2 * sizeof(struct skynet_context *));
-		for (i=0;i<s->slot_size;i++) {
-			int hash = skynet_context_handle(s->slot[i]) & (s->slot_size * 2 - 1);
-			assert(new_slot[hash] == NULL);
-			new_slot[hash] = s->slot[i];
+		assert((slot->size*2 - 1) <= HANDLE_MASK);
+		struct handle_slot * new_slot = slot_new(slot->size * 2);
+		for (i=0;i<slot->size;i++) {
+			int hash = skynet_context_handle(slot->ctx[i]) & (new_slot->size - 1);
+			assert(new_slot->ctx[hash] == NULL);
+			new_slot->ctx[hash] = slot->ctx[i];
 		}
-		skynet_free(s->slot);
-		s->slot = new_slot;
-		s->slot_size *= 2;
+		ATOM_STORE(&s->slot, new_slot);
+		// the readers may still use the old one
+		retire_memory(s, slot);
 	}
 }
 
@@ -73,24 +283,14 @@ skynet_handle_retire(uint32_t handle) {
 
 	rwlock_wlock(&s->lock);
 
-	uint32_t hash = handle & (s->slot_size-1);
-	struct skynet_context * ctx = s->slot[hash];
+	struct handle_slot *slot = s->slot;
+	uint32_t hash = handle & (slot->size-1);
+	struct skynet_context * ctx = slot->ctx[hash];
 
 	if (ctx != NULL && skynet_context_handle(ctx) == handle) {
-		s->slot[hash] = NULL;
+		ATOM_STORE(&slot->ctx[hash], NULL);
 		ret = 1;
-		int i;
-		int j=0, n=s->name_count;
-		for (i=0; i<n; ++i) {
-			if (s->name[i].handle == handle) {
-				skynet_free(s->name[i].name);
-				continue;
-			} else if (i!=j) {
-				s->name[j] = s->name[i];
-			}
-			++j;
-		}
-		s->name_count = j;
+		remove_names(s, handle);
 	} else {
 		ctx = NULL;
 	}
@@ -111,9 +311,13 @@ skynet_handle_retireall() {
 	for (;;) {
 		int n=0;
 		int i;
-		for (i=0;i<s->slot_size;i++) {
+		for (i=0;;i++) {
 			rwlock_rlock(&s->lock);
-			struct skynet_context * ctx = s->slot[i];
+			if (i >= s->slot->size) {
+				rwlock_runlock(&s->lock);
+				break;
+			}
+			struct skynet_context * ctx = s->slot->ctx[i];
 			uint32_t handle = 0;
 			if (ctx)
 				handle = skynet_context_handle(ctx);
@@ -134,16 +338,17 @@ skynet_handle_grab(uint32_t handle) {
 	struct handle_storage *s = H;
 	struct skynet_context * result = NULL;
 
-	rwlock_rlock(&s->lock);
+	struct handle_reader *r = reader_enter(s);
 
-	uint32_t hash = handle & (s->slot_size-1);
-	struct skynet_context * ctx = s->slot[hash];
-	if (ctx && skynet_context_handle(ctx) == handle) {
+	struct handle_slot *slot = ATOM_LOAD(&s->slot);
+	uint32_t hash = handle & (slot->size-1);
+	struct skynet_context * ctx = ATOM_LOAD_ACQ(&slot->ctx[hash]);
+	// the context may be retired at the same time, don't grab it if it's being deleted
+	if (ctx && skynet_context_handle(ctx) == handle && skynet_context_trygrab(ctx)) {
 		result = ctx;
-		skynet_context_grab(result);
 	}
 
-	rwlock_runlock(&s->lock);
+	reader_leave(r);
 
 	return result;
 }
@@ -151,81 +356,51 @@ skynet_handle_grab(uint32_t handle) {
 uint32_t 
 skynet_handle_findname(const char * name) {
 	struct handle_storage *s = H;
+	uint32_t hash = name_hash(name);
+	struct name_cache *c = &NAME_CACHE[hash & (NAME_CACHE_SIZE - 1)];
+	if (c->generation == ATOM_LOAD_ACQ(&s->name_generation) && c->hash == hash && strcmp(c->name, name) == 0) {
+		return c->handle;
+	}
 
 	rwlock_rlock(&s->lock);
 
 	uint32_t handle = 0;
-
-	int begin = 0;
-	int end = s->name_count - 1;
-	while (begin<=end) {
-		int mid = (begin+end)/2;
-		struct handle_name *n = &s->name[mid];
-		int c = strcmp(n->name, name);
-		if (c==0) {
-			handle = n->handle;
-			break;
-		}
-		if (c<0) {
-			begin = mid + 1;
-		} else {
-			end = mid - 1;
-		}
+	struct handle_name *n = find_name(s, name, hash);
+	if (n) {
+		handle = n->handle;
 	}
+	uint64_t generation = s->name_generation;
 
 	rwlock_runlock(&s->lock);
 
-	return handle;
-}
-
-static void
-_insert_name_before(struct handle_storage *s, char *name, uint32_t handle, int before) {
-	if (s->name_count >= s->name_cap) {
-		s->name_cap *= 2;
-		assert(s->name_cap <= MAX_SLOT_SIZE);
-		struct handle_name * n = skynet_malloc(s->name_cap * sizeof(struct handle_name));
-		int i;
-		for (i=0;i<before;i++) {
-			n[i] = s->name[i];
-		}
-		for (i=before;i<s->name_count;i++) {
-			n[i+1] = s->name[i];
-		}
-		skynet_free(s->name);
-		s->name = n;
-	} else {
-		int i;
-		for (i=s->name_count;i>before;i--) {
-			s->name[i] = s->name[i-1];
-		}
+	if (strlen(name) < NAME_CACHE_LENGTH) {
+		c->generation = generation;
+		c->hash = hash;
+		c->handle = handle;
+		strcpy(c->name, name);
 	}
-	s->name[before].name = name;
-	s->name[before].handle = handle;
-	s->name_count ++;
+
+	return handle;
 }
 
 static const char *
 _insert_name(struct handle_storage *s, const char * name, uint32_t handle) {
-	int begin = 0;
-	int end = s->name_count - 1;
-	while (begin<=end) {
-		int mid = (begin+end)/2;
-		struct handle_name *n = &s->name[mid];
-		int c = strcmp(n->name, name);
-		if (c==0) {
-			return NULL;
-		}
-		if (c<0) {
-			begin = mid + 1;
-		} else {
-			end = mid - 1;
-		}
+	uint32_t hash = name_hash(name);
+	if (find_name(s, name, hash)) {
+		return NULL;
 	}
-	char * result = skynet_strdup(name);
-
-	_insert_name_before(s, result, handle, begin);
-
-	return result;
+	if (s->name_count >= s->name_bucket) {
+		expand_name(s);
+	}
+	struct handle_name *n = skynet_malloc(sizeof(*n));
+	n->name = skynet_strdup(name);
+	n->hash = hash;
+	n->handle = handle;
+	link_name(s, n);
+	++s->name_count;
+	ATOM_INC(&s->name_generation);
+
+	return n->name;
 }
 
 const char * 
@@ -243,17 +418,23 @@ void
 skynet_handle_init(int harbor) {
 	assert(H==NULL);
 	struct handle_storage * s = skynet_malloc(sizeof(*H));
-	s->slot_size = DEFAULT_SLOT_SIZE;
-	s->slot = skynet_malloc(s->slot_size * sizeof(struct skynet_context *));
-	memset(s->slot, 0, s->slot_size * sizeof(struct skynet_context *));
+	s->slot = slot_new(DEFAULT_SLOT_SIZE);
 
 	rwlock_init(&s->lock);
+	s->epoch = 1;
+	s->reader = NULL;
+	spinlock_init(&s->lock_retired);
+	s->retired = NULL;
 	// reserve 0 for system
 	s->harbor = (uint32_t) (harbor & 0xff) << HANDLE_REMOTE_SHIFT;
 	s->handle_index = 1;
-	s->name_cap = 2;
+	s->name_bucket = DEFAULT_NAME_BUCKET;
 	s->name_count = 0;
-	s->name = skynet_malloc(s->name_cap * sizeof(struct handle_name));
+	s->name = skynet_malloc(s->name_bucket * sizeof(struct handle_name *));
+	memset(s->name, 0, s->name_bucket * sizeof(struct handle_name *));
+	s->name_handle = skynet_malloc(s->name_bucket * sizeof(struct handle_name *));
+	memset(s->name_handle, 0, s->name_bucket * sizeof(struct handle_name *));
+	s->name_generation = 1;
 
 	H = s;
 
@@ -11,7 +11,8 @@ struct skynet_context;
 
 uint32_t skynet_handle_register(struct skynet_context *);
 int skynet_handle_retire(uint32_t handle);
-struct skynet_context * skynet_handle_grab(uint32_t handle);
+struct skynet_context * skynet_handle_grab(uint32_t handle);	// lock-free
+void skynet_handle_free(void *ptr);	// free it after skynet_handle_grab in other threads can't see it
 void skynet_handle_retireall();
 
 uint32_t skynet_handle_findname(const char * name);
@@ -5,11 +5,23 @@ struct skynet_config {
 	int thread;
 	int harbor;
 	int profile;
+	int dispatch_slice;
+	int qwait;
+	int timer_tick;	// in millisecond
+	int timer_catchup_step;
+	int monitor_interval;	// in millisecond
+	int monitor_threshold;	// in millisecond, a message runs longer is reported
+	int socket_thread;
+	int socket_reuseport;
 	const char * daemon;
 	const char * module_path;
 	const char * bootstrap;
 	const char * logger;
 	const char * logservice;
+	const char * thread_affinity;	// cpu list of workers
+	const char * socket_cpu;
+	const char * timer_cpu;
+	const char * numa_policy;
 };
 
 #define THREAD_WORKER 0
@@ -165,6 +165,24 @@ main(int argc, char *argv[]) {
 	config.logger = optstring("logger", NULL);
 	config.logservice = optstring("logservice", "logger");
 	config.profile = optboolean("profile", 1);
+	config.qwait = optboolean("qwait", 1);
+	config.timer_tick = optint("timer_tick", 10);
+	const char * catchup = optstring("timer_catchup", "jump");
+	config.timer_catchup_step = strcmp(catchup, "step") == 0;
+	config.monitor_interval = optint("monitor_interval", 100);
+	config.monitor_threshold = optint("monitor_threshold", 1000);
+	config.socket_thread = optint("socket_thread", 1);
+	config.socket_reuseport = optboolean("socket_reuseport", 0);
+	config.thread_affinity = optstring("thread_affinity", NULL);
+	config.socket_cpu = optstring("socket_cpu", NULL);
+	config.timer_cpu = optstring("timer_cpu", NULL);
+	config.numa_policy = optstring("numa_policy", "default");
+	const char * dispatch = optstring("dispatch", "weight");
+	if (strcmp(dispatch, "adaptive") == 0) {
+		config.dispatch_slice = optint("dispatch_slice", 1000);
+	} else {
+		config.dispatch_slice = 0;
+	}
 
 	lua_close(L);
 
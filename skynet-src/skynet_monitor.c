@@ -2,6 +2,7 @@
 
 #include "skynet_monitor.h"
 #include "skynet_server.h"
+#include "skynet_timer.h"
 #include "skynet.h"
 #include "atomic.h"
 
@@ -11,8 +12,10 @@
 struct skynet_monitor {
 	int version;
 	int check_version;
+	int report_version;	// report a message only once
 	uint32_t source;
 	uint32_t destination;
+	uint64_t start;	// in centisecond
 };
 
 struct skynet_monitor * 
@@ -31,17 +34,26 @@ void
 skynet_monitor_trigger(struct skynet_monitor *sm, uint32_t source, uint32_t destination) {
 	sm->source = source;
 	sm->destination = destination;
+	if (destination) {
+		sm->start = skynet_now();
+	}
 	ATOM_INC(&sm->version);
 }
 
 void 
-skynet_monitor_check(struct skynet_monitor *sm) {
-	if (sm->version == sm->check_version) {
-		if (sm->destination) {
-			skynet_context_endless(sm->destination);
-			skynet_error(NULL, "A message from [ :%08x ] to [ :%08x ] maybe in an endless loop (version = %d)", sm->source , sm->destination, sm->version);
+skynet_monitor_check(struct skynet_monitor *sm, int threshold) {
+	int version = ATOM_LOAD(&sm->version);
+	if (version == sm->check_version) {
+		if (sm->destination && version != sm->report_version) {
+			uint64_t elapsed = skynet_now() - sm->start;
+			if (elapsed * 10 >= threshold) {
+				sm->report_version = version;
+				skynet_error(NULL, "A message from [ :%08x ] to [ :%08x ] runs for %d ms, maybe in an endless loop (version = %d)",
+					sm->source , sm->destination, (int)elapsed * 10, version);
+				skynet_context_endless(sm->destination);
+			}
 		}
 	} else {
-		sm->check_version = sm->version;
+		sm->check_version = version;
 	}
 }
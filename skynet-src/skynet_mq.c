@@ -2,15 +2,18 @@
 #include "skynet_mq.h"
 #include "skynet_handle.h"
 #include "spinlock.h"
+#include "atomic.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <stdbool.h>
-
-#define DEFAULT_QUEUE_SIZE 64
-#define MAX_GLOBAL_MQ 0x10000
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <sched.h>
 
 // 0 means mq is not in global mq.
 // 1 means mq is in global mq , or the message is dispatching.
@@ -18,32 +21,115 @@
 #define MQ_IN_GLOBAL 1
 #define MQ_OVERLOAD 1024
 
-struct message_queue {
+// The message queue is an intrusive multi-producer/single-consumer list (Dmitry Vyukov's design).
+// Producers (any thread) append a node with one atomic swap of tail, so skynet_mq_push never waits.
+// Only the worker who owns the queue (in_global == MQ_IN_GLOBAL) pops from head.
+// head is always a stub node, the first message is head->next.
+
+struct message_node {
+	struct message_node *next;
+	uint64_t enqueue;	// in microsecond by the coarse clock, 0 when qwait is off
+	struct skynet_message msg;
+};
+
+// The nodes are freed by the consumer and allocated by the producers, which are usually other threads.
+// Each thread caches the freed nodes in chains of NODE_CHAIN, and gives the full chains to a shared pool,
+// so a node costs no malloc and a chain costs one spinlock, whichever thread frees it.
+#define NODE_CHAIN 64
+#define NODE_POOL_MAX 1024	// the chains in the shared pool at most, the more are freed
+
+struct node_cache {
+	struct message_node *head;	// the current chain
+	int n;
+	struct message_node *full;	// a full chain, it keeps the cache away from the pool when n crosses NODE_CHAIN
+};
+
+// The chains in the pool are linked by msg.data of their first node.
+struct node_pool {
 	struct spinlock lock;
-	uint32_t handle;
-	int cap;
-	int head;
-	int tail;
-	int release;
+	struct message_node *chain;
+	int n;
+};
+
+// The spins before the consumer yields, when a producer has swapped tail but not linked the node yet.
+#define LINK_SPIN 64
+
+// The log2 histograms of latency in microsecond, the slots are the upper bounds.
+#define HIST_SLOTS 24
+
+struct message_queue {
+	// producer side
+	struct message_node *tail;
+	int length;
 	int in_global;
+	int release;
+	uint32_t handle;
+	int priority;
+	int limit;	// 0 means unbounded
+	int policy;
+	int dropped;
+	// consumer side
+	struct message_node *head;
 	int overload;
 	int overload_threshold;
-	struct skynet_message *queue;
+	int peak;
+	uint32_t qwait_hist[HIST_SLOTS];	// enqueue to dispatch
 	struct message_queue *next;
 };
 
+// Runnable queues live in per-worker run queues. A worker pushes and pops its own run queue,
+// and steals from other workers when it's idle. Other threads (main, socket, timer) inject into Q.
+
+// Each priority class has its own run queues, the higher class is always popped first.
+// The batch class is popped first every BATCH_MQ_TICK pops, so its share is bounded but it can't be starved.
+
+#define STEAL_MAX 64
+// Check the inject queue first every GLOBAL_MQ_TICK pops, so it can't be starved by a busy worker.
+#define GLOBAL_MQ_TICK 61
+#define BATCH_MQ_TICK 8
+
 struct global_queue {
 	struct message_queue *head;
 	struct message_queue *tail;
+	int count;
 	struct spinlock lock;
 };
 
-static struct global_queue *Q = NULL;
+// An idle worker parks on its own cond, and the producer who makes a queue runnable wakes exactly one of them.
+// The wakeup latency (from signal to the worker running) is collected into log2 buckets in microsecond.
+
+struct worker_queue {
+	struct global_queue q[MQ_PRIORITY_CLASS];
+	unsigned tick;
+	int parked;
+	uint64_t wake_time;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint32_t wake_hist[HIST_SLOTS];
+	uint32_t qwait_hist[HIST_SLOTS];	// the queue wait of all the messages dispatched by this worker
+	char padding[64];
+};
 
-void 
-skynet_globalmq_push(struct message_queue * queue) {
-	struct global_queue *q= Q;
+struct idle_workers {
+	struct spinlock lock;
+	int count;
+	int quit;
+	int *id;
+};
+
+static struct global_queue Q[MQ_PRIORITY_CLASS];
+static struct worker_queue **W = NULL;	// W[id] is NULL until the worker starts
+static int QWAIT = 0;	// stamp the messages for queue wait statistics
+static int WORKER = 0;
+static struct idle_workers IDLE;
+static struct node_pool NODE_POOL;
+static __thread struct node_cache NODE_CACHE;
 
+// -1 means the thread is not a worker
+static __thread int WORKER_ID = -1;
+
+static void
+queue_push(struct global_queue *q, struct message_queue * queue) {
 	SPIN_LOCK(q)
 	assert(queue->next == NULL);
 	if(q->tail) {
@@ -52,13 +138,16 @@ skynet_globalmq_push(struct message_queue * queue) {
 	} else {
 		q->head = q->tail = queue;
 	}
+	++q->count;
 	SPIN_UNLOCK(q)
 }
 
-struct message_queue * 
-skynet_globalmq_pop() {
-	struct global_queue *q = Q;
-
+static struct message_queue *
+queue_pop(struct global_queue *q) {
+	if (q->head == NULL) {
+		// fast path without lock, the queue may be pushed later but it's harmless.
+		return NULL;
+	}
 	SPIN_LOCK(q)
 	struct message_queue *mq = q->head;
 	if(mq) {
@@ -68,28 +157,438 @@ skynet_globalmq_pop() {
 			q->tail = NULL;
 		}
 		mq->next = NULL;
+		--q->count;
 	}
 	SPIN_UNLOCK(q)
 
 	return mq;
 }
 
+// Move half of victim's queues into self, and return the first one.
+static struct message_queue *
+queue_steal(struct global_queue *self, struct global_queue *victim) {
+	if (victim->head == NULL || !spinlock_trylock(&victim->lock)) {
+		return NULL;
+	}
+	struct message_queue *first = victim->head;
+	if (first == NULL) {
+		SPIN_UNLOCK(victim)
+		return NULL;
+	}
+	int n = (victim->count + 1) / 2;
+	if (n > STEAL_MAX) {
+		n = STEAL_MAX;
+	}
+	struct message_queue *last = first;
+	int i;
+	for (i=1;i<n;i++) {
+		last = last->next;
+	}
+	victim->head = last->next;
+	if (victim->head == NULL) {
+		victim->tail = NULL;
+	}
+	victim->count -= n;
+	last->next = NULL;
+	SPIN_UNLOCK(victim)
+
+	struct message_queue *rest = first->next;
+	first->next = NULL;
+	if (rest) {
+		SPIN_LOCK(self)
+		if (self->tail) {
+			self->tail->next = rest;
+		} else {
+			self->head = rest;
+		}
+		self->tail = last;
+		self->count += n - 1;
+		SPIN_UNLOCK(self)
+	}
+	return first;
+}
+
+static uint64_t
+nanotime() {
+	struct timespec ti;
+	clock_gettime(CLOCK_MONOTONIC, &ti);
+	return (uint64_t)ti.tv_sec * 1000000000 + ti.tv_nsec;
+}
+
+// The coarse clock is cheap enough to stamp each message, but its resolution is only about 1-4ms.
+static inline uint64_t
+coarsetime() {
+	struct timespec ti;
+#ifdef CLOCK_MONOTONIC_COARSE
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ti);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ti);
+#endif
+	return (uint64_t)ti.tv_sec * 1000000 + ti.tv_nsec / 1000 + 1;	// never 0
+}
+
+static inline int
+hist_slot(uint64_t us) {
+	int slot = 0;
+	while (us && slot < HIST_SLOTS - 1) {
+		us >>= 1;
+		++slot;
+	}
+	return slot;
+}
+
+static int
+hist_stat(const uint32_t hist[HIST_SLOTS], uint32_t *count, uint32_t *p50, uint32_t *p99, uint32_t *max) {
+	uint32_t total = 0;
+	int j;
+	for (j=0;j<HIST_SLOTS;j++) {
+		total += hist[j];
+	}
+	*count = total;
+	*p50 = *p99 = *max = 0;
+	if (total == 0)
+		return 0;
+	uint32_t acc = 0;
+	for (j=0;j<HIST_SLOTS;j++) {
+		if (hist[j] == 0)
+			continue;
+		uint32_t bound = 1u << j;
+		if (acc < (total + 1) / 2 && acc + hist[j] >= (total + 1) / 2) {
+			*p50 = bound;
+		}
+		if (acc < total - total / 100 && acc + hist[j] >= total - total / 100) {
+			*p99 = bound;
+		}
+		acc += hist[j];
+		*max = bound;
+	}
+	return 1;
+}
+
+static void
+wakeup_one() {
+	SPIN_LOCK(&IDLE)
+	if (IDLE.count == 0) {
+		SPIN_UNLOCK(&IDLE)
+		return;
+	}
+	int id = IDLE.id[--IDLE.count];
+	SPIN_UNLOCK(&IDLE)
+
+	struct worker_queue *w = W[id];
+	pthread_mutex_lock(&w->mutex);
+	w->parked = 0;
+	w->wake_time = nanotime();
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+}
+
+void 
+skynet_globalmq_push(struct message_queue * queue) {
+	int id = WORKER_ID;
+	int priority = queue->priority;
+	if (id >= 0) {
+		queue_push(&W[id]->q[priority], queue);
+	} else {
+		queue_push(&Q[priority], queue);
+	}
+	// pair with the barrier in skynet_globalmq_park
+	__sync_synchronize();
+	if (IDLE.count > 0) {
+		wakeup_one();
+	}
+}
+
+static struct message_queue *
+pop_class(struct worker_queue *w, int priority) {
+	struct message_queue *mq = queue_pop(&w->q[priority]);
+	if (mq)
+		return mq;
+	return queue_pop(&Q[priority]);
+}
+
+struct message_queue * 
+skynet_globalmq_trypop() {
+	int id = WORKER_ID;
+	struct message_queue *mq;
+	int i;
+	if (id < 0) {
+		for (i=0;i<MQ_PRIORITY_CLASS;i++) {
+			mq = queue_pop(&Q[i]);
+			if (mq)
+				return mq;
+		}
+		return NULL;
+	}
+	struct worker_queue *w = W[id];
+	unsigned tick = ++w->tick;
+	if (tick % GLOBAL_MQ_TICK == 0) {
+		for (i=0;i<MQ_PRIORITY_CLASS;i++) {
+			mq = queue_pop(&Q[i]);
+			if (mq)
+				return mq;
+		}
+	}
+	if (tick % BATCH_MQ_TICK == 0) {
+		mq = pop_class(w, MQ_PRIORITY_BATCH);
+		if (mq)
+			return mq;
+	}
+	for (i=0;i<MQ_PRIORITY_CLASS;i++) {
+		mq = pop_class(w, i);
+		if (mq)
+			return mq;
+	}
+	return NULL;
+}
+
+struct message_queue * 
+skynet_globalmq_pop() {
+	struct message_queue *mq = skynet_globalmq_trypop();
+	int id = WORKER_ID;
+	if (mq || id < 0)
+		return mq;
+	int i,j;
+	for (i=0;i<MQ_PRIORITY_CLASS;i++) {
+		for (j=1;j<WORKER;j++) {
+			struct worker_queue *victim = ATOM_LOAD_ACQ(&W[(id + j) % WORKER]);
+			if (victim == NULL)
+				continue;
+			mq = queue_steal(&W[id]->q[i], &victim->q[i]);
+			if (mq)
+				return mq;
+		}
+	}
+	return NULL;
+}
+
+static int
+has_runnable() {
+	int i,j;
+	for (i=0;i<MQ_PRIORITY_CLASS;i++) {
+		if (Q[i].head)
+			return 1;
+		for (j=0;j<WORKER;j++) {
+			struct worker_queue *w = ATOM_LOAD_ACQ(&W[j]);
+			if (w && w->q[i].head)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+// remove self from idle list, return 0 if a producer has already taken it.
+static int
+unpark(int id) {
+	int ret = 0;
+	SPIN_LOCK(&IDLE)
+	int i;
+	for (i=0;i<IDLE.count;i++) {
+		if (IDLE.id[i] == id) {
+			IDLE.id[i] = IDLE.id[--IDLE.count];
+			ret = 1;
+			break;
+		}
+	}
+	SPIN_UNLOCK(&IDLE)
+	return ret;
+}
+
+static void
+wake_record(struct worker_queue *w, uint64_t wake_time) {
+	++w->wake_hist[hist_slot((nanotime() - wake_time) / 1000)];
+}
+
+void
+skynet_globalmq_park() {
+	int id = WORKER_ID;
+	assert(id >= 0);
+	struct worker_queue *w = W[id];
+
+	// set parked before it can be seen in the idle list
+	pthread_mutex_lock(&w->mutex);
+	w->parked = 1;
+	w->wake_time = 0;
+	pthread_mutex_unlock(&w->mutex);
+
+	SPIN_LOCK(&IDLE)
+	IDLE.id[IDLE.count++] = id;
+	SPIN_UNLOCK(&IDLE)
+
+	// A queue may be pushed before we are in the idle list, check again.
+	__sync_synchronize();
+	if ((has_runnable() || IDLE.quit) && unpark(id)) {
+		pthread_mutex_lock(&w->mutex);
+		w->parked = 0;
+		pthread_mutex_unlock(&w->mutex);
+		return;
+	}
+
+	pthread_mutex_lock(&w->mutex);
+	while (w->parked && !IDLE.quit) {
+		pthread_cond_wait(&w->cond, &w->mutex);
+	}
+	uint64_t wake_time = w->wake_time;
+	if (wake_time) {
+		wake_record(w, wake_time);
+	}
+	w->parked = 0;
+	pthread_mutex_unlock(&w->mutex);
+}
+
+void
+skynet_globalmq_quit() {
+	SPIN_LOCK(&IDLE)
+	IDLE.quit = 1;
+	IDLE.count = 0;
+	SPIN_UNLOCK(&IDLE)
+	int i;
+	for (i=0;i<WORKER;i++) {
+		struct worker_queue *w = ATOM_LOAD_ACQ(&W[i]);
+		if (w == NULL)
+			continue;	// it will see quit when it starts
+		pthread_mutex_lock(&w->mutex);
+		pthread_cond_signal(&w->cond);
+		pthread_mutex_unlock(&w->mutex);
+	}
+}
+
+// The histogram is merged from all workers on read.
+int
+skynet_globalmq_wakeup_stat(uint32_t *count, uint32_t *p50, uint32_t *p99, uint32_t *max) {
+	uint32_t hist[HIST_SLOTS];
+	memset(hist, 0, sizeof(hist));
+	int i,j;
+	for (i=0;i<WORKER;i++) {
+		struct worker_queue *w = ATOM_LOAD_ACQ(&W[i]);
+		if (w == NULL)
+			continue;
+		for (j=0;j<HIST_SLOTS;j++) {
+			hist[j] += w->wake_hist[j];
+		}
+	}
+	return hist_stat(hist, count, p50, p99, max);
+}
+
+// The worker allocates its own structure from fresh pages, they are first touched (so placed) on its NUMA node.
+static struct worker_queue *
+worker_new() {
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t sz = (sizeof(struct worker_queue) + page - 1) / page * page;
+	struct worker_queue *w = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (w == MAP_FAILED) {
+		fprintf(stderr, "Alloc worker queue error");
+		exit(1);
+	}
+	memset(w, 0, sizeof(*w));
+	int i;
+	for (i=0;i<MQ_PRIORITY_CLASS;i++) {
+		SPIN_INIT(&w->q[i]);
+	}
+	if (pthread_mutex_init(&w->mutex, NULL)) {
+		fprintf(stderr, "Init mutex error");
+		exit(1);
+	}
+	if (pthread_cond_init(&w->cond, NULL)) {
+		fprintf(stderr, "Init cond error");
+		exit(1);
+	}
+	return w;
+}
+
+void
+skynet_globalmq_initthread(int worker) {
+	assert(worker >= 0 && worker < WORKER);
+	assert(W[worker] == NULL);
+	ATOM_STORE_REL(&W[worker], worker_new());
+	WORKER_ID = worker;
+}
+
+static struct message_node *
+node_alloc() {
+	struct node_cache *c = &NODE_CACHE;
+	if (c->head == NULL) {
+		if (c->full) {
+			c->head = c->full;
+			c->full = NULL;
+		} else {
+			SPIN_LOCK(&NODE_POOL)
+			struct message_node *chain = NODE_POOL.chain;
+			if (chain) {
+				NODE_POOL.chain = chain->msg.data;
+				--NODE_POOL.n;
+			}
+			SPIN_UNLOCK(&NODE_POOL)
+			if (chain == NULL) {
+				// the pool is empty, malloc a chain so the pool is not locked for each node
+				int i;
+				for (i=0;i<NODE_CHAIN;i++) {
+					struct message_node *node = skynet_malloc(sizeof(*node));
+					node->next = chain;
+					chain = node;
+				}
+			}
+			c->head = chain;
+		}
+		c->n = NODE_CHAIN;
+	}
+	struct message_node *node = c->head;
+	c->head = node->next;
+	--c->n;
+	return node;
+}
+
+static void
+node_free(struct message_node *node) {
+	struct node_cache *c = &NODE_CACHE;
+	if (c->n >= NODE_CHAIN) {
+		struct message_node *chain = c->full;
+		c->full = c->head;
+		c->head = NULL;
+		c->n = 0;
+		if (chain) {
+			SPIN_LOCK(&NODE_POOL)
+			if (NODE_POOL.n < NODE_POOL_MAX) {
+				chain->msg.data = NODE_POOL.chain;
+				NODE_POOL.chain = chain;
+				++NODE_POOL.n;
+				chain = NULL;
+			}
+			SPIN_UNLOCK(&NODE_POOL)
+			while (chain) {
+				struct message_node *next = chain->next;
+				skynet_free(chain);
+				chain = next;
+			}
+		}
+	}
+	node->next = c->head;
+	c->head = node;
+	++c->n;
+}
+
 struct message_queue * 
 skynet_mq_create(uint32_t handle) {
 	struct message_queue *q = skynet_malloc(sizeof(*q));
+	struct message_node *stub = node_alloc();
+	stub->next = NULL;
 	q->handle = handle;
-	q->cap = DEFAULT_QUEUE_SIZE;
-	q->head = 0;
-	q->tail = 0;
-	SPIN_INIT(q)
+	q->head = stub;
+	q->tail = stub;
+	q->length = 0;
 	// When the queue is create (always between service create and service init) ,
 	// set in_global flag to avoid push it to global queue .
 	// If the service init success, skynet_context_new will call skynet_mq_push to push it to global queue.
 	q->in_global = MQ_IN_GLOBAL;
 	q->release = 0;
+	q->priority = MQ_PRIORITY_NORMAL;
+	q->limit = 0;
+	q->policy = MQ_LIMIT_REJECT;
+	q->dropped = 0;
 	q->overload = 0;
 	q->overload_threshold = MQ_OVERLOAD;
-	q->queue = skynet_malloc(sizeof(struct skynet_message) * q->cap);
+	q->peak = 0;
+	memset(q->qwait_hist, 0, sizeof(q->qwait_hist));
 	q->next = NULL;
 
 	return q;
@@ -98,8 +597,8 @@ skynet_mq_create(uint32_t handle) {
 static void 
 _release(struct message_queue *q) {
 	assert(q->next == NULL);
-	SPIN_DESTROY(q)
-	skynet_free(q->queue);
+	assert(q->head == q->tail);
+	node_free(q->head);
 	skynet_free(q);
 }
 
@@ -108,20 +607,76 @@ skynet_mq_handle(struct message_queue *q) {
 	return q->handle;
 }
 
+void
+skynet_mq_priority(struct message_queue *q, int priority) {
+	assert(priority >= 0 && priority < MQ_PRIORITY_CLASS);
+	// It takes effect when the queue is pushed into run queue next time.
+	q->priority = priority;
+}
+
 int
-skynet_mq_length(struct message_queue *q) {
-	int head, tail,cap;
+skynet_mq_getpriority(struct message_queue *q) {
+	return q->priority;
+}
 
-	SPIN_LOCK(q)
-	head = q->head;
-	tail = q->tail;
-	cap = q->cap;
-	SPIN_UNLOCK(q)
-	
-	if (head <= tail) {
-		return tail - head;
+void
+skynet_mq_limit(struct message_queue *q, int limit, int policy) {
+	assert(policy == MQ_LIMIT_REJECT || policy == MQ_LIMIT_DROP || policy == MQ_LIMIT_SIGNAL);
+	q->policy = policy;
+	ATOM_STORE(&q->limit, limit > 0 ? limit : 0);
+}
+
+int
+skynet_mq_getlimit(struct message_queue *q, int *policy) {
+	if (policy) {
+		*policy = q->policy;
+	}
+	return ATOM_LOAD(&q->limit);
+}
+
+// Count the messages rejected or dropped by the limit, return the total.
+int
+skynet_mq_drop(struct message_queue *q, int n) {
+	return ATOM_ADD(&q->dropped, n);
+}
+
+// The histogram of a queue is written only by its owner, and the node wide one is merged from workers on read.
+int
+skynet_mq_qwait(struct message_queue *q, uint32_t *count, uint32_t *p50, uint32_t *p99, uint32_t *max) {
+	if (q) {
+		return hist_stat(q->qwait_hist, count, p50, p99, max);
 	}
-	return tail + cap - head;
+	uint32_t hist[HIST_SLOTS];
+	memset(hist, 0, sizeof(hist));
+	int i,j;
+	for (i=0;i<WORKER;i++) {
+		struct worker_queue *w = ATOM_LOAD_ACQ(&W[i]);
+		if (w == NULL)
+			continue;
+		for (j=0;j<HIST_SLOTS;j++) {
+			hist[j] += w->qwait_hist[j];
+		}
+	}
+	return hist_stat(hist, count, p50, p99, max);
+}
+
+int
+skynet_mq_length(struct message_queue *q) {
+	return ATOM_LOAD(&q->length);
+}
+
+// The queue holds one node for each message and a stub node, so the memory goes back as soon as the messages are popped.
+size_t
+skynet_mq_memory(struct message_queue *q) {
+	return sizeof(*q) + (ATOM_LOAD(&q->length) + 1) * sizeof(struct message_node);
+}
+
+// The max length since last call, for watching bursts.
+int
+skynet_mq_peak(struct message_queue *q) {
+	int peak = q->peak;
+	q->peak = 0;
+	return peak;
 }
 
 int
@@ -134,97 +689,156 @@ skynet_mq_overload(struct message_queue *q) {
 	return 0;
 }
 
+// Only the owner of the queue can call it
 int
-skynet_mq_pop(struct message_queue *q, struct skynet_message *message) {
-	int ret = 1;
-	SPIN_LOCK(q)
-
-	if (q->head != q->tail) {
-		*message = q->queue[q->head++];
-		ret = 0;
-		int head = q->head;
-		int tail = q->tail;
-		int cap = q->cap;
-
-		if (head >= cap) {
-			q->head = head = 0;
+skynet_mq_pop_batch(struct message_queue *q, struct skynet_message *message, uint64_t *enqueue, int max) {
+	int n = 0;
+	struct message_node *head = q->head;
+	while (n < max) {
+		struct message_node *next = ATOM_LOAD_ACQ(&head->next);
+		if (next == NULL) {
+			if (n > 0) {
+				// don't wait for the producers, we still own the queue.
+				break;
+			}
+			if (ATOM_LOAD(&q->tail) == head) {
+				// reset overload_threshold when queue is empty
+				q->overload_threshold = MQ_OVERLOAD;
+				// Leave the queue, and check again. A producer who swapped tail before it sees in_global == 0
+				// will not push the queue into global mq, so we must take it back.
+				ATOM_STORE(&q->in_global, 0);
+				if (ATOM_LOAD(&q->tail) == head) {
+					return 0;
+				}
+				if (!ATOM_CAS(&q->in_global, 0, MQ_IN_GLOBAL)) {
+					// The producer has already pushed it into global mq.
+					return 0;
+				}
+			}
+			// A producer has swapped tail but not linked the node yet, it's only a few instructions.
+			// But the producer may be preempted, so yield the cpu to it after LINK_SPIN spins.
+			int spin = 0;
+			while ((next = ATOM_LOAD_ACQ(&head->next)) == NULL) {
+				if (++spin >= LINK_SPIN) {
+					sched_yield();
+				}
+			}
 		}
-		int length = tail - head;
-		if (length < 0) {
-			length += cap;
+		if (enqueue) {
+			enqueue[n] = next->enqueue;
 		}
-		while (length > q->overload_threshold) {
-			q->overload = length;
-			q->overload_threshold *= 2;
-		}
-	} else {
-		// reset overload_threshold when queue is empty
-		q->overload_threshold = MQ_OVERLOAD;
+		message[n++] = next->msg;
+		node_free(head);
+		head = next;
 	}
+	q->head = head;
 
-	if (ret) {
-		q->in_global = 0;
+	return n;
+}
+
+// The wait is counted when the message is dispatched, it may wait in the batch of worker after pop.
+void
+skynet_mq_qwait_record(struct message_queue *q, uint64_t enqueue) {
+	if (enqueue == 0)
+		return;
+	uint64_t now = coarsetime();
+	int slot = hist_slot(now > enqueue ? now - enqueue : 0);
+	++q->qwait_hist[slot];
+	if (WORKER_ID >= 0) {
+		++W[WORKER_ID]->qwait_hist[slot];
 	}
-	
-	SPIN_UNLOCK(q)
+}
 
-	return ret;
+void
+skynet_mq_consume(struct message_queue *q, int n) {
+	int length = ATOM_SUB(&q->length, n);
+	if (length + n > q->peak) {
+		q->peak = length + n;
+	}
+	while (length > q->overload_threshold) {
+		q->overload = length;
+		q->overload_threshold *= 2;
+	}
 }
 
-static void
-expand_queue(struct message_queue *q) {
-	struct skynet_message *new_queue = skynet_malloc(sizeof(struct skynet_message) * q->cap * 2);
-	int i;
-	for (i=0;i<q->cap;i++) {
-		new_queue[i] = q->queue[(q->head + i) % q->cap];
+// Only the owner of the queue can call it
+int
+skynet_mq_pop(struct message_queue *q, struct skynet_message *message) {
+	if (skynet_mq_pop_batch(q, message, NULL, 1) == 0) {
+		return 1;
 	}
-	q->head = 0;
-	q->tail = q->cap;
-	q->cap *= 2;
-	
-	skynet_free(q->queue);
-	q->queue = new_queue;
+	skynet_mq_consume(q, 1);
+	return 0;
 }
 
 void 
 skynet_mq_push(struct message_queue *q, struct skynet_message *message) {
 	assert(message);
-	SPIN_LOCK(q)
+	skynet_mq_push_batch(q, message, 1);
+}
 
-	q->queue[q->tail] = *message;
-	if (++ q->tail >= q->cap) {
-		q->tail = 0;
+// The nodes are linked privately first, and then appended as a whole.
+void
+skynet_mq_push_batch(struct message_queue *q, struct skynet_message *message, int n) {
+	if (n <= 0)
+		return;
+	uint64_t now = QWAIT ? coarsetime() : 0;
+	struct message_node *first = NULL;
+	struct message_node *last = NULL;
+	int i;
+	for (i=0;i<n;i++) {
+		struct message_node *node = node_alloc();
+		node->next = NULL;
+		node->enqueue = now;
+		node->msg = message[i];
+		if (last) {
+			last->next = node;
+		} else {
+			first = node;
+		}
+		last = node;
 	}
 
-	if (q->head == q->tail) {
-		expand_queue(q);
-	}
+	// increase length before the nodes are visible, so the consumer never sees a negative length.
+	ATOM_ADD(&q->length, n);
+	struct message_node *prev = ATOM_SWAP(&q->tail, last);
+	ATOM_STORE_REL(&prev->next, first);
 
-	if (q->in_global == 0) {
-		q->in_global = MQ_IN_GLOBAL;
+	if (ATOM_LOAD(&q->in_global) == 0 && ATOM_CAS(&q->in_global, 0, MQ_IN_GLOBAL)) {
 		skynet_globalmq_push(q);
 	}
-	
-	SPIN_UNLOCK(q)
 }
 
 void 
-skynet_mq_init() {
-	struct global_queue *q = skynet_malloc(sizeof(*q));
-	memset(q,0,sizeof(*q));
-	SPIN_INIT(q);
-	Q=q;
+skynet_mq_init(int worker, int qwait) {
+	QWAIT = qwait;
+	int i;
+	memset(Q, 0, sizeof(Q));
+	for (i=0;i<MQ_PRIORITY_CLASS;i++) {
+		SPIN_INIT(&Q[i]);
+	}
+
+	assert(worker > 0);
+	W = skynet_malloc(worker * sizeof(struct worker_queue *));
+	memset(W, 0, worker * sizeof(struct worker_queue *));
+	WORKER = worker;
+
+	SPIN_INIT(&IDLE)
+	SPIN_INIT(&NODE_POOL)
+	NODE_POOL.chain = NULL;
+	NODE_POOL.n = 0;
+	IDLE.count = 0;
+	IDLE.quit = 0;
+	IDLE.id = skynet_malloc(worker * sizeof(int));
 }
 
 void 
 skynet_mq_mark_release(struct message_queue *q) {
-	SPIN_LOCK(q)
 	assert(q->release == 0);
-	q->release = 1;
-	if (q->in_global != MQ_IN_GLOBAL) {
+	ATOM_STORE(&q->release, 1);
+	if (ATOM_LOAD(&q->in_global) == 0 && ATOM_CAS(&q->in_global, 0, MQ_IN_GLOBAL)) {
 		skynet_globalmq_push(q);
 	}
-	SPIN_UNLOCK(q)
 }
 
 static void
@@ -236,15 +850,13 @@ _drop_queue(struct message_queue *q, message_drop drop_func, void *ud) {
 	_release(q);
 }
 
+// Only the owner of the queue can call it
 void 
 skynet_mq_release(struct message_queue *q, message_drop drop_func, void *ud) {
-	SPIN_LOCK(q)
-	
-	if (q->release) {
-		SPIN_UNLOCK(q)
+	if (ATOM_LOAD(&q->release)) {
 		_drop_queue(q, drop_func, ud);
 	} else {
+		// skynet_mq_mark_release will not push q while we own it, so push it back for the next round.
 		skynet_globalmq_push(q);
-		SPIN_UNLOCK(q)
 	}
 }
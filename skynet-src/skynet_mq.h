@@ -11,14 +11,30 @@ struct skynet_message {
 	size_t sz;
 };
 
-// type is encoding in skynet_message.sz high 8bit
-#define MESSAGE_TYPE_MASK (SIZE_MAX >> 8)
+// type is encoding in skynet_message.sz high 8bit, the next bit marks the shared payload of skynet_send_multi
+#define MESSAGE_TYPE_MASK (SIZE_MAX >> 9)
 #define MESSAGE_TYPE_SHIFT ((sizeof(size_t)-1) * 8)
+#define MESSAGE_SHARED ((size_t)1 << (MESSAGE_TYPE_SHIFT - 1))
+
+#define MQ_PRIORITY_INTERACTIVE 0
+#define MQ_PRIORITY_NORMAL 1
+#define MQ_PRIORITY_BATCH 2
+#define MQ_PRIORITY_CLASS 3
+
+// What to do when a service sends to a queue which reaches its limit, see skynet_mq_limit.
+#define MQ_LIMIT_REJECT 0	// the send fails, and the caller gets an error
+#define MQ_LIMIT_DROP 1	// the oldest messages are dropped by the consumer, and the send fails beyond twice the limit
+#define MQ_LIMIT_SIGNAL 2	// the message is accepted, and the sender is told about the backpressure
 
 struct message_queue;
 
-void skynet_globalmq_push(struct message_queue * queue);
-struct message_queue * skynet_globalmq_pop(void);
+void skynet_globalmq_push(struct message_queue * queue);	// into the run queue of current worker, or the inject queue
+struct message_queue * skynet_globalmq_pop(void);	// steal from other workers if there is nothing to run
+struct message_queue * skynet_globalmq_trypop(void);	// don't steal
+void skynet_globalmq_initthread(int worker);	// call it in the worker thread, it allocates the per-worker structure
+void skynet_globalmq_park(void);	// block current worker until a queue is runnable
+void skynet_globalmq_quit(void);	// wakeup all the parked workers for exit
+int skynet_globalmq_wakeup_stat(uint32_t *count, uint32_t *p50, uint32_t *p99, uint32_t *max);	// in microsecond
 
 struct message_queue * skynet_mq_create(uint32_t handle);
 void skynet_mq_mark_release(struct message_queue *q);
@@ -27,15 +43,34 @@ typedef void (*message_drop)(struct skynet_message *, void *);
 
 void skynet_mq_release(struct message_queue *q, message_drop drop_func, void *ud);
 uint32_t skynet_mq_handle(struct message_queue *);
+void skynet_mq_priority(struct message_queue *, int priority);
+int skynet_mq_getpriority(struct message_queue *);
+void skynet_mq_limit(struct message_queue *, int limit, int policy);	// limit 0 means unbounded
+int skynet_mq_getlimit(struct message_queue *, int *policy);
+int skynet_mq_drop(struct message_queue *, int n);
 
 // 0 for success
 int skynet_mq_pop(struct message_queue *q, struct skynet_message *message);
+// pop at most max messages, return the number of messages. 0 means the queue is empty, and leaves the global mq.
+// The popped messages are still counted in the length until skynet_mq_consume.
+// enqueue[i] (if enqueue is not NULL) is the push time of message[i] for skynet_mq_qwait_record, 0 when qwait is off.
+int skynet_mq_pop_batch(struct message_queue *q, struct skynet_message *message, uint64_t *enqueue, int max);
+// n popped messages are dispatched (or dropped)
+void skynet_mq_consume(struct message_queue *q, int n);
+// a message pushed at enqueue is dispatched now
+void skynet_mq_qwait_record(struct message_queue *q, uint64_t enqueue);
 void skynet_mq_push(struct message_queue *q, struct skynet_message *message);
+// push n messages with one atomic swap
+void skynet_mq_push_batch(struct message_queue *q, struct skynet_message *message, int n);
 
 // return the length of message queue, for debug
 int skynet_mq_length(struct message_queue *q);
+size_t skynet_mq_memory(struct message_queue *q);	// bytes used by the queue
+int skynet_mq_peak(struct message_queue *q);	// max length since last call
 int skynet_mq_overload(struct message_queue *q);
+// the histogram of the time from push to dispatch in microsecond, q == NULL for the whole node
+int skynet_mq_qwait(struct message_queue *q, uint32_t *count, uint32_t *p50, uint32_t *p99, uint32_t *max);
 
-void skynet_mq_init();
+void skynet_mq_init(int worker, int qwait);
 
 #endif
@@ -10,6 +10,7 @@
 #include "skynet_monitor.h"
 #include "skynet_imp.h"
 #include "skynet_log.h"
+#include "skynet_socket.h"
 #include "skynet_timer.h"
 #include "spinlock.h"
 #include "atomic.h"
@@ -21,6 +22,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef CALLING_CHECK
 
@@ -49,14 +51,19 @@ struct skynet_context {
 	FILE * logfile;
 	uint64_t cpu_cost;	// in microsec
 	uint64_t cpu_start;	// in microsec
-	char result[32];
+	double message_cost;	// in microsec, moving average cost per message for adaptive dispatch
+	char result[64];
 	uint32_t handle;
 	int session_id;
 	int ref;
 	int message_count;
+	int turn_count;
+	int backpressure;	// sends to the bounded queues over limit, with signal policy
+	int long_dispatch;	// messages reported by the monitor
 	bool init;
 	bool endless;
 	bool profile;
+	bool forward;	// see skynet_callback_forward
 
 	CHECKCALLING_DECL
 };
@@ -67,6 +74,7 @@ struct skynet_node {
 	uint32_t monitor_exit;
 	pthread_key_t handle_key;
 	bool profile;	// default is off
+	int dispatch_slice;	// in microsec, 0 means use the weight of worker
 };
 
 static struct skynet_node G_NODE;
@@ -112,10 +120,49 @@ struct drop_t {
 	uint32_t handle;
 };
 
+// The payload shared by the messages of skynet_send_multi, it's freed when the last receiver releases it.
+// The shared message points to it. data is the buffer of sender (PTYPE_TAG_DONTCOPY), or the copy after it.
+struct shared_payload {
+	int ref;
+	void * data;
+};
+
+static inline void *
+message_data(struct skynet_message *msg) {
+	if (msg->sz & MESSAGE_SHARED) {
+		struct shared_payload *p = msg->data;
+		return p->data;
+	}
+	return msg->data;
+}
+
+static void
+release_payload(struct shared_payload *p) {
+	if (ATOM_DEC(&p->ref) == 0) {
+		if (p->data != (void *)(p + 1)) {
+			skynet_free(p->data);
+		}
+		skynet_free(p);
+	}
+}
+
+static void
+free_message(struct skynet_message *msg) {
+	if (msg->sz & MESSAGE_SHARED) {
+		release_payload(msg->data);
+	} else {
+		skynet_free(msg->data);
+	}
+}
+
 static void
 drop_message(struct skynet_message *msg, void *ud) {
 	struct drop_t *d = ud;
-	skynet_free(msg->data);
+	if ((msg->sz >> MESSAGE_TYPE_SHIFT) == PTYPE_SOCKET) {
+		// the receive buffers in it go back to the socket pool
+		skynet_socket_drop(msg->data);
+	}
+	free_message(msg);
 	uint32_t source = d->handle;
 	assert(source);
 	// report error to the message source
@@ -146,10 +193,15 @@ skynet_context_new(const char * name, const char *param) {
 
 	ctx->init = false;
 	ctx->endless = false;
+	ctx->forward = false;
 
 	ctx->cpu_cost = 0;
 	ctx->cpu_start = 0;
 	ctx->message_count = 0;
+	ctx->turn_count = 0;
+	ctx->message_cost = 0;
+	ctx->backpressure = 0;
+	ctx->long_dispatch = 0;
 	ctx->profile = G_NODE.profile;
 	// Should set to 0 first to avoid skynet_handle_retireall get an uninitialized handle
 	ctx->handle = 0;	
@@ -198,6 +250,18 @@ skynet_context_grab(struct skynet_context *ctx) {
 	ATOM_INC(&ctx->ref);
 }
 
+int
+skynet_context_trygrab(struct skynet_context *ctx) {
+	int ref = ATOM_LOAD(&ctx->ref);
+	while (ref > 0) {
+		if (ATOM_CAS(&ctx->ref, ref, ref + 1)) {
+			return 1;
+		}
+		ref = ATOM_LOAD(&ctx->ref);
+	}
+	return 0;
+}
+
 void
 skynet_context_reserve(struct skynet_context *ctx) {
 	skynet_context_grab(ctx);
@@ -214,7 +278,8 @@ delete_context(struct skynet_context *ctx) {
 	skynet_module_instance_release(ctx->mod, ctx->instance);
 	skynet_mq_mark_release(ctx->queue);
 	CHECKCALLING_DESTROY(ctx)
-	skynet_free(ctx);
+	// skynet_handle_grab may be reading it
+	skynet_handle_free(ctx);
 	context_dec();
 }
 
@@ -227,6 +292,48 @@ skynet_context_release(struct skynet_context *ctx) {
 	return ctx;
 }
 
+// Responses and errors are never limited, or the callers would wait forever.
+static inline bool
+limited_type(int type) {
+	return type != PTYPE_RESPONSE && type != PTYPE_ERROR;
+}
+
+// Only the messages sent by services are limited (see cmd_limit), the system messages (timer, socket, logger) use skynet_context_push.
+// return -2 when the destination rejects it.
+static int
+push_context(struct skynet_context *context, struct skynet_context *ctx, struct skynet_message *message) {
+	int policy;
+	int limit = skynet_mq_getlimit(ctx->queue, &policy);
+	if (limit > 0 && limited_type(message->sz >> MESSAGE_TYPE_SHIFT)) {
+		int length = skynet_mq_length(ctx->queue);
+		// The consumer drops the oldest ones with MQ_LIMIT_DROP, but it can't when it's stalled.
+		// So reject the new ones beyond twice the limit, the memory is still bounded.
+		if ((policy == MQ_LIMIT_REJECT && length >= limit)
+			|| (policy == MQ_LIMIT_DROP && length >= limit * 2)) {
+			skynet_mq_drop(ctx->queue, 1);
+			return -2;
+		}
+		if (policy == MQ_LIMIT_SIGNAL && length >= limit && context) {
+			++context->backpressure;
+		}
+	}
+	skynet_mq_push(ctx->queue, message);
+
+	return 0;
+}
+
+static int
+push_limited(struct skynet_context *context, uint32_t handle, struct skynet_message *message) {
+	struct skynet_context * ctx = skynet_handle_grab(handle);
+	if (ctx == NULL) {
+		return -1;
+	}
+	int err = push_context(context, ctx, message);
+	skynet_context_release(ctx);
+
+	return err;
+}
+
 int
 skynet_context_push(uint32_t handle, struct skynet_message *message) {
 	struct skynet_context * ctx = skynet_handle_grab(handle);
@@ -239,6 +346,19 @@ skynet_context_push(uint32_t handle, struct skynet_message *message) {
 	return 0;
 }
 
+// push n messages to one service, the queue is grabbed once.
+int
+skynet_context_push_batch(uint32_t handle, struct skynet_message *message, int n) {
+	struct skynet_context * ctx = skynet_handle_grab(handle);
+	if (ctx == NULL) {
+		return -1;
+	}
+	skynet_mq_push_batch(ctx->queue, message, n);
+	skynet_context_release(ctx);
+
+	return 0;
+}
+
 void 
 skynet_context_endless(uint32_t handle) {
 	struct skynet_context * ctx = skynet_handle_grab(handle);
@@ -246,6 +366,9 @@ skynet_context_endless(uint32_t handle) {
 		return;
 	}
 	ctx->endless = true;
+	ATOM_INC(&ctx->long_dispatch);
+	// snlua logs the lua traceback
+	skynet_module_instance_signal(ctx->mod, ctx->instance, 2);
 	skynet_context_release(ctx);
 }
 
@@ -265,20 +388,27 @@ dispatch_message(struct skynet_context *ctx, struct skynet_message *msg) {
 	pthread_setspecific(G_NODE.handle_key, (void *)(uintptr_t)(ctx->handle));
 	int type = msg->sz >> MESSAGE_TYPE_SHIFT;
 	size_t sz = msg->sz & MESSAGE_TYPE_MASK;
+	void * data = message_data(msg);
 	if (ctx->logfile) {
-		skynet_log_output(ctx->logfile, msg->source, type, msg->session, msg->data, sz);
+		skynet_log_output(ctx->logfile, msg->source, type, msg->session, data, sz);
 	}
 	++ctx->message_count;
 	int reserve_msg;
 	if (ctx->profile) {
 		ctx->cpu_start = skynet_thread_time();
-		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, msg->data, sz);
+		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, data, sz);
 		uint64_t cost_time = skynet_thread_time() - ctx->cpu_start;
 		ctx->cpu_cost += cost_time;
 	} else {
-		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, msg->data, sz);
+		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, data, sz);
 	}
-	if (!reserve_msg) {
+	if (msg->sz & MESSAGE_SHARED) {
+		// the shared payload can't be reserved
+		if (reserve_msg) {
+			skynet_error(ctx, "Can't reserve the shared message from %x", msg->source);
+		}
+		free_message(msg);
+	} else if (!reserve_msg) {
 		skynet_free(msg->data);
 	}
 	CHECKCALLING_END(ctx)
@@ -294,6 +424,69 @@ skynet_context_dispatchall(struct skynet_context * ctx) {
 	}
 }
 
+// messages popped from the queue at once in dispatch
+#define DISPATCH_BATCH 32
+
+// How many messages to dispatch in this turn. length is the number of messages in queue besides the first one.
+static int
+dispatch_batch(struct skynet_context *ctx, int length, int weight) {
+	// batch services yield after each message whatever the policy is, they go on only when there is nothing else to run.
+	if (skynet_mq_getpriority(ctx->queue) == MQ_PRIORITY_BATCH)
+		return 1;
+	int slice = G_NODE.dispatch_slice;
+	if (slice <= 0) {
+		if (weight < 0)
+			return 1;
+		return length >> weight;
+	}
+	// adaptive : dispatch messages as much as the time slice allows
+	double cost = ctx->message_cost;
+	if (cost < 1.0) {
+		cost = 1.0;
+	}
+	double n = slice / cost;
+	if (n >= length + 1) {
+		return length + 1;
+	}
+	if (n < 1) {
+		return 1;
+	}
+	return (int)n;
+}
+
+// Drop a message when the queue is over the limit with drop policy, the caller (if any) gets an error.
+// The system messages are never dropped : the payload of socket (and multicast) messages is not a plain skynet_malloc block,
+// and a lost socket data breaks the stream.
+static bool
+drop_oldest(struct skynet_context *ctx, struct skynet_message *msg) {
+	int type = msg->sz >> MESSAGE_TYPE_SHIFT;
+	if (!limited_type(type)) {
+		return false;
+	}
+	switch (type) {
+	case PTYPE_MULTICAST:
+	case PTYPE_SYSTEM:
+	case PTYPE_HARBOR:
+	case PTYPE_SOCKET:
+		return false;
+	}
+	free_message(msg);
+	if (msg->session > 0) {
+		skynet_send(NULL, ctx->handle, msg->source, PTYPE_ERROR, msg->session, NULL, 0);
+	}
+	return true;
+}
+
+static void
+update_cost(struct skynet_context *ctx, uint64_t cost, int n) {
+	double c = (double)cost / n;
+	if (ctx->message_cost == 0) {
+		ctx->message_cost = c;
+	} else {
+		ctx->message_cost = ctx->message_cost * 0.875 + c * 0.125;
+	}
+}
+
 struct message_queue * 
 skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue *q, int weight) {
 	if (q == NULL) {
@@ -311,35 +504,83 @@ skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue
 		return skynet_globalmq_pop();
 	}
 
-	int i,n=1;
-	struct skynet_message msg;
+	bool adaptive = G_NODE.dispatch_slice > 0;
+	uint64_t turn_start = 0;
+	if (adaptive) {
+		turn_start = ctx->profile ? ctx->cpu_cost : skynet_thread_time();
+	}
 
-	for (i=0;i<n;i++) {
-		if (skynet_mq_pop(q,&msg)) {
-			skynet_context_release(ctx);
-			return skynet_globalmq_pop();
-		} else if (i==0 && weight >= 0) {
-			n = skynet_mq_length(q);
-			n >>= weight;
+	// n is the number of messages to dispatch in this turn, at least one.
+	int n = dispatch_batch(ctx, skynet_mq_length(q) - 1, weight);
+	if (n < 1) {
+		n = 1;
+	}
+	struct skynet_message msg[DISPATCH_BATCH];
+	uint64_t enqueue[DISPATCH_BATCH];
+	int i, count = 0;
+	bool empty = false;
+
+	// the number of messages over the limit, they are dropped in this turn.
+	// The dropped ones don't count in n, the system messages (see drop_oldest) are dispatched as usual.
+	int policy, drop = 0;
+	int limit = skynet_mq_getlimit(q, &policy);
+	if (limit > 0 && policy == MQ_LIMIT_DROP) {
+		drop = skynet_mq_length(q) - limit;
+	}
+
+	while (count < n) {
+		int batch = n - count;
+		if (batch > DISPATCH_BATCH) {
+			batch = DISPATCH_BATCH;
 		}
-		int overload = skynet_mq_overload(q);
-		if (overload) {
-			skynet_error(ctx, "May overload, message queue length = %d", overload);
+		batch = skynet_mq_pop_batch(q, msg, enqueue, batch);
+		if (batch == 0) {
+			empty = true;
+			break;
 		}
+		for (i=0;i<batch;i++) {
+			// The messages not dispatched yet are still in the length of queue
+			skynet_mq_consume(q, 1);
+			int overload = skynet_mq_overload(q);
+			if (overload) {
+				skynet_error(ctx, "May overload, message queue length = %d", overload);
+			}
+			if (drop > 0 && drop_oldest(ctx, &msg[i])) {
+				--drop;
+				skynet_mq_drop(q, 1);
+				continue;
+			}
+			skynet_monitor_trigger(sm, msg[i].source , handle);
 
-		skynet_monitor_trigger(sm, msg.source , handle);
+			if (ctx->cb == NULL) {
+				free_message(&msg[i]);
+			} else {
+				skynet_mq_qwait_record(q, enqueue[i]);
+				dispatch_message(ctx, &msg[i]);
+			}
 
-		if (ctx->cb == NULL) {
-			skynet_free(msg.data);
-		} else {
-			dispatch_message(ctx, &msg);
+			skynet_monitor_trigger(sm, 0,0);
+			++count;
+		}
+	}
+
+	if (count > 0) {
+		++ctx->turn_count;
+		if (adaptive) {
+			uint64_t turn_cost = ctx->profile ? ctx->cpu_cost - turn_start : skynet_thread_time() - turn_start;
+			update_cost(ctx, turn_cost, count);
 		}
+	}
 
-		skynet_monitor_trigger(sm, 0,0);
+	if (empty) {
+		// the queue is not in global mq now
+		skynet_context_release(ctx);
+		return skynet_globalmq_pop();
 	}
 
 	assert(q == ctx->queue);
-	struct message_queue *nq = skynet_globalmq_pop();
+	// Don't steal from other workers only for switching
+	struct message_queue *nq = skynet_globalmq_trypop();
 	if (nq) {
 		// If global mq is not empty , push q back, and return next queue (nq)
 		// Else (global mq is empty or block, don't push q back, and return q again (for next dispatch)
@@ -405,6 +646,44 @@ cmd_timeout(struct skynet_context * context, const char * param) {
 	return context->result;
 }
 
+static const char *
+cmd_timeout_ms(struct skynet_context * context, const char * param) {
+	char * session_ptr = NULL;
+	int ti = strtol(param, &session_ptr, 10);
+	int session = skynet_context_newsession(context);
+	skynet_timeout_ms(context->handle, ti, session);
+	sprintf(context->result, "%d", session);
+	return context->result;
+}
+
+// TIMER ti / TIMERMS ti : like TIMEOUT and TIMEOUTMS, but return "session id", the id is for CANCEL.
+static const char *
+timer_start(struct skynet_context * context, const char * param, int ms) {
+	int ti = strtol(param, NULL, 10);
+	int session = skynet_context_newsession(context);
+	int id = ms ? skynet_timeout_ms(context->handle, ti, session) : skynet_timeout(context->handle, ti, session);
+	sprintf(context->result, "%d %d", session, id);
+	return context->result;
+}
+
+static const char *
+cmd_timer(struct skynet_context * context, const char * param) {
+	return timer_start(context, param, 0);
+}
+
+static const char *
+cmd_timer_ms(struct skynet_context * context, const char * param) {
+	return timer_start(context, param, 1);
+}
+
+// CANCEL id : return "1" if the timer is removed, "0" if it has expired.
+static const char *
+cmd_cancel(struct skynet_context * context, const char * param) {
+	int id = strtol(param, NULL, 10);
+	sprintf(context->result, "%d", skynet_timer_cancel(context->handle, id));
+	return context->result;
+}
+
 static const char *
 cmd_reg(struct skynet_context * context, const char * param) {
 	if (param == NULL || param[0] == '\0') {
@@ -558,6 +837,18 @@ cmd_stat(struct skynet_context * context, const char * param) {
 	if (strcmp(param, "mqlen") == 0) {
 		int len = skynet_mq_length(context->queue);
 		sprintf(context->result, "%d", len);
+	} else if (strcmp(param, "mqmem") == 0) {
+		size_t sz = skynet_mq_memory(context->queue);
+		sprintf(context->result, "%zu", sz);
+	} else if (strcmp(param, "mqpeak") == 0) {
+		int peak = skynet_mq_peak(context->queue);
+		sprintf(context->result, "%d", peak);
+	} else if (strcmp(param, "dropped") == 0) {
+		int dropped = skynet_mq_drop(context->queue, 0);
+		sprintf(context->result, "%d", dropped);
+	} else if (strcmp(param, "backpressure") == 0) {
+		sprintf(context->result, "%d", context->backpressure);
+		context->backpressure = 0;
 	} else if (strcmp(param, "endless") == 0) {
 		if (context->endless) {
 			strcpy(context->result, "1");
@@ -565,6 +856,8 @@ cmd_stat(struct skynet_context * context, const char * param) {
 		} else {
 			strcpy(context->result, "0");
 		}
+	} else if (strcmp(param, "long") == 0) {
+		sprintf(context->result, "%d", ATOM_LOAD(&context->long_dispatch));
 	} else if (strcmp(param, "cpu") == 0) {
 		double t = (double)context->cpu_cost / 1000000.0;	// microsec
 		sprintf(context->result, "%lf", t);
@@ -578,12 +871,94 @@ cmd_stat(struct skynet_context * context, const char * param) {
 		}
 	} else if (strcmp(param, "message") == 0) {
 		sprintf(context->result, "%d", context->message_count);
+	} else if (strcmp(param, "turn") == 0) {
+		sprintf(context->result, "%d", context->turn_count);
+	} else if (strcmp(param, "cost") == 0) {
+		sprintf(context->result, "%lf", context->message_cost);
 	} else {
 		context->result[0] = '\0';
 	}
 	return context->result;
 }
 
+static const char * priority_name[MQ_PRIORITY_CLASS] = { "interactive", "normal", "batch" };
+
+// PRIORITY [interactive|normal|batch] : set the priority class of current service, return the current one.
+static const char *
+cmd_priority(struct skynet_context * context, const char * param) {
+	if (param && param[0] != '\0') {
+		int i;
+		for (i=0;i<MQ_PRIORITY_CLASS;i++) {
+			if (strcmp(param, priority_name[i]) == 0) {
+				skynet_mq_priority(context->queue, i);
+				break;
+			}
+		}
+		if (i == MQ_PRIORITY_CLASS) {
+			skynet_error(context, "Invalid priority class %s", param);
+			return NULL;
+		}
+	}
+	strcpy(context->result, priority_name[skynet_mq_getpriority(context->queue)]);
+	return context->result;
+}
+
+static const char * limit_policy[] = { "reject", "drop", "signal" };
+
+// LIMIT [n [reject|drop|signal]] : set the queue limit of current service, 0 means unbounded. return "n policy"
+static const char *
+cmd_limit(struct skynet_context * context, const char * param) {
+	if (param && param[0] != '\0') {
+		char policy_name[16] = "reject";
+		int limit = 0;
+		if (sscanf(param, "%d %15s", &limit, policy_name) < 1) {
+			skynet_error(context, "Invalid limit %s", param);
+			return NULL;
+		}
+		int i;
+		for (i=0;i<sizeof(limit_policy)/sizeof(limit_policy[0]);i++) {
+			if (strcmp(policy_name, limit_policy[i]) == 0) {
+				break;
+			}
+		}
+		if (i == sizeof(limit_policy)/sizeof(limit_policy[0])) {
+			skynet_error(context, "Invalid limit policy %s", policy_name);
+			return NULL;
+		}
+		skynet_mq_limit(context->queue, limit, i);
+	}
+	int policy;
+	int limit = skynet_mq_getlimit(context->queue, &policy);
+	sprintf(context->result, "%d %s", limit, limit_policy[policy]);
+	return context->result;
+}
+
+// QWAIT [node] : the queue wait of current service (or the whole node), "count p50 p99 max" in microsecond
+static const char *
+cmd_qwait(struct skynet_context * context, const char * param) {
+	uint32_t count, p50, p99, max;
+	bool node = param && strcmp(param, "node") == 0;
+	skynet_mq_qwait(node ? NULL : context->queue, &count, &p50, &p99, &max);
+	sprintf(context->result, "%u %u %u %u", count, p50, p99, max);
+	return context->result;
+}
+
+static const char *
+cmd_timerlag(struct skynet_context * context, const char * param) {
+	uint32_t last, max, stalls, jumps;
+	skynet_timer_lag(&last, &max, &stalls, &jumps);
+	sprintf(context->result, "%u %u %u %u", last, max, stalls, jumps);
+	return context->result;
+}
+
+static const char *
+cmd_wakeup(struct skynet_context * context, const char * param) {
+	uint32_t count, p50, p99, max;
+	skynet_globalmq_wakeup_stat(&count, &p50, &p99, &max);
+	sprintf(context->result, "%u %u %u %u", count, p50, p99, max);
+	return context->result;
+}
+
 static const char *
 cmd_logon(struct skynet_context * context, const char * param) {
 	uint32_t handle = tohandle(context, param);
@@ -646,8 +1021,26 @@ cmd_signal(struct skynet_context * context, const char * param) {
 	return NULL;
 }
 
+// the long dispatch count of any service, it doesn't need the service to respond
+static const char *
+cmd_long(struct skynet_context * context, const char * param) {
+	uint32_t handle = tohandle(context, param);
+	if (handle == 0)
+		return NULL;
+	struct skynet_context * ctx = skynet_handle_grab(handle);
+	if (ctx == NULL)
+		return NULL;
+	sprintf(context->result, "%d", ATOM_LOAD(&ctx->long_dispatch));
+	skynet_context_release(ctx);
+	return context->result;
+}
+
 static struct command_func cmd_funcs[] = {
 	{ "TIMEOUT", cmd_timeout },
+	{ "TIMEOUTMS", cmd_timeout_ms },
+	{ "TIMER", cmd_timer },
+	{ "TIMERMS", cmd_timer_ms },
+	{ "CANCEL", cmd_cancel },
 	{ "REG", cmd_reg },
 	{ "QUERY", cmd_query },
 	{ "NAME", cmd_name },
@@ -663,6 +1056,12 @@ static struct command_func cmd_funcs[] = {
 	{ "LOGON", cmd_logon },
 	{ "LOGOFF", cmd_logoff },
 	{ "SIGNAL", cmd_signal },
+	{ "WAKEUP", cmd_wakeup },
+	{ "TIMERLAG", cmd_timerlag },
+	{ "PRIORITY", cmd_priority },
+	{ "LIMIT", cmd_limit },
+	{ "QWAIT", cmd_qwait },
+	{ "LONG", cmd_long },
 	{ NULL, NULL },
 };
 
@@ -738,14 +1137,93 @@ skynet_send(struct skynet_context * context, uint32_t source, uint32_t destinati
 		smsg.data = data;
 		smsg.sz = sz;
 
-		if (skynet_context_push(destination, &smsg)) {
+		int err = push_limited(context, destination, &smsg);
+		if (err) {
 			skynet_free(data);
-			return -1;
+			return err;
 		}
 	}
 	return session;
 }
 
+int
+skynet_send_multi(struct skynet_context * context, uint32_t source, const uint32_t *destination, int n, int type, void * data, size_t sz) {
+	if ((sz & MESSAGE_TYPE_MASK) != sz) {
+		skynet_error(context, "The multicast message is too large");
+		if (type & PTYPE_TAG_DONTCOPY) {
+			skynet_free(data);
+		}
+		return -1;
+	}
+	if (source == 0) {
+		source = context->handle;
+	}
+	struct shared_payload *p = NULL;
+	if (data && sz > 0) {
+		if (type & PTYPE_TAG_DONTCOPY) {
+			// share the buffer of sender, without copy
+			p = skynet_malloc(sizeof(*p));
+			p->data = data;
+		} else {
+			p = skynet_malloc(sizeof(*p) + sz);
+			p->data = p + 1;
+			memcpy(p->data, data, sz);
+		}
+		// hold it until all the messages are pushed
+		p->ref = 1;
+	} else if (type & PTYPE_TAG_DONTCOPY) {
+		skynet_free(data);
+	}
+	type &= 0xff;
+	int count = 0;
+	int i;
+	for (i=0;i<n;i++) {
+		uint32_t des = destination[i];
+		if (des == 0)
+			continue;
+		if (skynet_harbor_message_isremote(des)) {
+			// the remote one gets its own copy
+			if (skynet_send(context, source, des, type, 0, p ? p->data : NULL, sz) >= 0) {
+				++count;
+			}
+			continue;
+		}
+		struct skynet_context * ctx = skynet_handle_grab(des);
+		if (ctx == NULL)
+			continue;
+		struct skynet_message smsg;
+		smsg.source = source;
+		smsg.session = 0;
+		smsg.data = NULL;
+		smsg.sz = sz | (size_t)type << MESSAGE_TYPE_SHIFT;
+		if (p) {
+			if (ctx->forward) {
+				// the callback may keep it, so it gets its own copy
+				smsg.data = skynet_malloc(sz);
+				memcpy(smsg.data, p->data, sz);
+			} else {
+				smsg.data = p;
+				smsg.sz |= MESSAGE_SHARED;
+				ATOM_INC(&p->ref);
+			}
+		}
+		if (push_context(context, ctx, &smsg)) {
+			if (smsg.sz & MESSAGE_SHARED) {
+				ATOM_DEC(&p->ref);
+			} else {
+				skynet_free(smsg.data);
+			}
+		} else {
+			++count;
+		}
+		skynet_context_release(ctx);
+	}
+	if (p) {
+		release_payload(p);
+	}
+	return count;
+}
+
 int
 skynet_sendname(struct skynet_context * context, uint32_t source, const char * addr , int type, int session, void * data, size_t sz) {
 	// int i;
@@ -796,6 +1274,11 @@ skynet_callback(struct skynet_context * context, void *ud, skynet_cb cb) {
 	context->cb_ud = ud;
 }
 
+void
+skynet_callback_forward(struct skynet_context * context, int forward) {
+	context->forward = forward ? true : false;
+}
+
 void
 skynet_context_send(struct skynet_context * ctx, void * msg, size_t sz, uint32_t source, int type, int session) {
 	struct skynet_message smsg;
@@ -835,3 +1318,8 @@ void
 skynet_profile_enable(int enable) {
 	G_NODE.profile = (bool)enable;
 }
+
+void
+skynet_dispatch_slice(int slice) {
+	G_NODE.dispatch_slice = slice;
+}
@@ -12,11 +12,34 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#define BATCH_SERVICE 16	// the services batched at the same time in one shard
+#define BATCH_MAX 256	// the data in one batch message
+#define BATCH_INIT 8	// the batch grows from it to BATCH_MAX
+
+struct socket_batch {
+	uint32_t opaque;
+	int n;
+	int cap;
+	struct skynet_socket_message *msg;	// msg[0] is the header, msg[1..n] are the data
+};
+
+// Only the socket thread of the shard uses it
+struct batch_shard {
+	int n;
+	struct socket_batch batch[BATCH_SERVICE];
+};
+
 static struct socket_server * SOCKET_SERVER = NULL;
+static struct batch_shard * BATCH = NULL;
 
 void 
-skynet_socket_init() {
-	SOCKET_SERVER = socket_server_create();
+skynet_socket_init(int thread, int reuseport) {
+	if (thread < 1) {
+		thread = 1;
+	}
+	SOCKET_SERVER = socket_server_create_shards(thread, reuseport);
+	BATCH = skynet_malloc(thread * sizeof(*BATCH));
+	memset(BATCH, 0, thread * sizeof(*BATCH));
 }
 
 void
@@ -28,9 +51,11 @@ void
 skynet_socket_free() {
 	socket_server_release(SOCKET_SERVER);
 	SOCKET_SERVER = NULL;
+	skynet_free(BATCH);
+	BATCH = NULL;
 }
 
-// mainloop thread
+// socket thread
 static void
 forward_message(int type, bool padding, struct socket_message * result) {
 	struct skynet_socket_message *sm;
@@ -66,22 +91,117 @@ forward_message(int type, bool padding, struct socket_message * result) {
 	if (skynet_context_push((uint32_t)result->opaque, &message)) {
 		// todo: report somewhere to close socket
 		// don't call skynet_socket_close here (It will block mainloop)
-		skynet_free(sm->buffer);
+		socket_server_free_data(sm->buffer, sm->ud);
+		skynet_free(sm);
+	}
+}
+
+static void
+flush_batch(struct batch_shard *bs, int index) {
+	struct socket_batch *b = &bs->batch[index];
+	struct skynet_socket_message *sm = b->msg;
+	int n = b->n;
+	sm->type = SKYNET_SOCKET_TYPE_BATCH;
+	sm->id = 0;
+	sm->ud = n;
+	sm->buffer = NULL;
+
+	struct skynet_message message;
+	message.source = 0;
+	message.session = 0;
+	message.data = sm;
+	message.sz = (n + 1) * sizeof(*sm) | ((size_t)PTYPE_SOCKET << MESSAGE_TYPE_SHIFT);
+
+	if (skynet_context_push(b->opaque, &message)) {
+		int i;
+		for (i=1;i<=n;i++) {
+			socket_server_free_data(sm[i].buffer, sm[i].ud);
+		}
 		skynet_free(sm);
 	}
+	*b = bs->batch[--bs->n];
+}
+
+static void
+flush_service(struct batch_shard *bs, uint32_t opaque) {
+	int i;
+	for (i=0;i<bs->n;i++) {
+		if (bs->batch[i].opaque == opaque) {
+			flush_batch(bs, i);
+			return;
+		}
+	}
+}
+
+static void
+flush_all(struct batch_shard *bs) {
+	while (bs->n > 0) {
+		flush_batch(bs, bs->n - 1);
+	}
+}
+
+// return false if it can't be batched
+static bool
+batch_data(struct batch_shard *bs, struct socket_message * result) {
+	uint32_t opaque = (uint32_t)result->opaque;
+	struct socket_batch *b = NULL;
+	int i;
+	for (i=0;i<bs->n;i++) {
+		if (bs->batch[i].opaque == opaque) {
+			b = &bs->batch[i];
+			break;
+		}
+	}
+	if (b == NULL) {
+		if (bs->n >= BATCH_SERVICE) {
+			return false;
+		}
+		b = &bs->batch[bs->n++];
+		b->opaque = opaque;
+		b->n = 0;
+		b->cap = BATCH_INIT;
+		b->msg = skynet_malloc((b->cap + 1) * sizeof(struct skynet_socket_message));
+	} else if (b->n >= b->cap) {
+		b->cap *= 2;
+		b->msg = skynet_realloc(b->msg, (b->cap + 1) * sizeof(struct skynet_socket_message));
+	}
+	struct skynet_socket_message *sm = &b->msg[++b->n];
+	sm->type = SKYNET_SOCKET_TYPE_DATA;
+	sm->id = result->id;
+	sm->ud = result->ud;
+	sm->buffer = result->data;
+	if (b->n == BATCH_MAX) {
+		flush_batch(bs, b - bs->batch);
+	}
+	return true;
 }
 
 int 
-skynet_socket_poll() {
+skynet_socket_poll(int shard) {
 	struct socket_server *ss = SOCKET_SERVER;
 	assert(ss);
+	struct batch_shard *bs = &BATCH[shard];
 	struct socket_message result;
 	int more = 1;
-	int type = socket_server_poll(ss, &result, &more);
+	int type = socket_server_poll_shard(ss, shard, &result, &more);
+	if (bs->n > 0) {
+		if (type < 0) {
+			// the end of this round
+			flush_all(bs);
+		} else if (type != SOCKET_DATA || !socket_server_isbatch(ss, result.id)) {
+			// keep the order of messages to the service
+			flush_service(bs, (uint32_t)result.opaque);
+		}
+	}
 	switch (type) {
+	case -1:
+		return -1;
 	case SOCKET_EXIT:
 		return 0;
 	case SOCKET_DATA:
+		if (socket_server_isbatch(ss, result.id) && batch_data(bs, &result)) {
+			break;
+		}
 		forward_message(SKYNET_SOCKET_TYPE_DATA, false, &result);
 		break;
 	case SOCKET_CLOSE:
@@ -168,6 +288,11 @@ skynet_socket_nodelay(struct skynet_context *ctx, int id) {
 	socket_server_nodelay(SOCKET_SERVER, id);
 }
 
+void
+skynet_socket_batch(struct skynet_context *ctx, int id, int enable) {
+	socket_server_batch(SOCKET_SERVER, id, enable);
+}
+
 int 
 skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port) {
 	uint32_t source = skynet_context_handle(ctx);
@@ -184,6 +309,37 @@ skynet_socket_udp_send(struct skynet_context *ctx, int id, const char * address,
 	return socket_server_udp_send(SOCKET_SERVER, id, (const struct socket_udp_address *)address, buffer, sz);
 }
 
+void
+skynet_socket_free_data(void *buffer, int sz) {
+	socket_server_free_data(buffer, sz);
+}
+
+void
+skynet_socket_drop(struct skynet_socket_message *sm) {
+	switch (sm->type) {
+	case SKYNET_SOCKET_TYPE_DATA:
+	case SKYNET_SOCKET_TYPE_UDP:
+		socket_server_free_data(sm->buffer, sm->ud);
+		break;
+	case SKYNET_SOCKET_TYPE_BATCH: {
+		int i;
+		for (i=1;i<=sm->ud;i++) {
+			socket_server_free_data(sm[i].buffer, sm[i].ud);
+		}
+		break;
+	}
+	}
+}
+
+void
+skynet_socket_buffer_stat(uint64_t *alloc, uint64_t *reuse, uint64_t *cached) {
+	struct socket_buffer_stat stat;
+	socket_server_buffer_stat(&stat);
+	*alloc = stat.alloc;
+	*reuse = stat.reuse;
+	*cached = stat.cached;
+}
+
 const char *
 skynet_socket_udp_address(struct skynet_socket_message *msg, int *addrsz) {
 	if (msg->type != SKYNET_SOCKET_TYPE_UDP) {
@@ -1,6 +1,8 @@
 #ifndef skynet_socket_h
 #define skynet_socket_h
 
+#include <stdint.h>
+
 struct skynet_context;
 
 #define SKYNET_SOCKET_TYPE_DATA 1
@@ -10,6 +12,8 @@ struct skynet_context;
 #define SKYNET_SOCKET_TYPE_ERROR 5
 #define SKYNET_SOCKET_TYPE_UDP 6
 #define SKYNET_SOCKET_TYPE_WARNING 7
+// ud is the number of SKYNET_SOCKET_TYPE_DATA messages packed after the header (buffer is NULL)
+#define SKYNET_SOCKET_TYPE_BATCH 8
 
 struct skynet_socket_message {
 	int type;
@@ -18,10 +22,10 @@ struct skynet_socket_message {
 	char * buffer;
 };
 
-void skynet_socket_init();
+void skynet_socket_init(int thread, int reuseport);
 void skynet_socket_exit();
 void skynet_socket_free();
-int skynet_socket_poll();
+int skynet_socket_poll(int shard);
 
 int skynet_socket_send(struct skynet_context *ctx, int id, void *buffer, int sz);
 int skynet_socket_send_lowpriority(struct skynet_context *ctx, int id, void *buffer, int sz);
@@ -32,10 +36,19 @@ void skynet_socket_close(struct skynet_context *ctx, int id);
 void skynet_socket_shutdown(struct skynet_context *ctx, int id);
 void skynet_socket_start(struct skynet_context *ctx, int id);
 void skynet_socket_nodelay(struct skynet_context *ctx, int id);
+// The data of socket id polled in one round are packed into one SKYNET_SOCKET_TYPE_BATCH message for each service.
+// The service which the socket belongs to should handle SKYNET_SOCKET_TYPE_BATCH.
+void skynet_socket_batch(struct skynet_context *ctx, int id, int enable);
 
 int skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port);
 int skynet_socket_udp_connect(struct skynet_context *ctx, int id, const char * addr, int port);
 int skynet_socket_udp_send(struct skynet_context *ctx, int id, const char * address, const void *buffer, int sz);
 const char * skynet_socket_udp_address(struct skynet_socket_message *, int *addrsz);
 
+// free the buffer of SKYNET_SOCKET_TYPE_DATA or SKYNET_SOCKET_TYPE_UDP, sz is the ud of message. It's cached for the next read.
+void skynet_socket_free_data(void *buffer, int sz);
+// free the buffers in a socket message which is never dispatched (the service is gone), not the message itself.
+void skynet_socket_drop(struct skynet_socket_message *);
+void skynet_socket_buffer_stat(uint64_t *alloc, uint64_t *reuse, uint64_t *cached);
+
 #endif
@@ -9,6 +9,7 @@
 #include "skynet_socket.h"
 #include "skynet_daemon.h"
 #include "skynet_harbor.h"
+#include "skynet_affinity.h"
 
 #include <pthread.h>
 #include <unistd.h>
@@ -21,16 +22,24 @@
 struct monitor {
 	int count;
 	struct skynet_monitor ** m;
-	pthread_cond_t cond;
-	pthread_mutex_t mutex;
-	int sleep;
 	int quit;
+	int interval;	// in millisecond
+	int threshold;	// in millisecond
 };
 
 struct worker_parm {
 	struct monitor *m;
 	int id;
 	int weight;
+	int numa_policy;
+};
+
+// The cpu sets of each thread class, empty set means no affinity.
+struct thread_layout {
+	struct skynet_cpuset worker;	// one cpu for each worker, round robin
+	struct skynet_cpuset socket;
+	struct skynet_cpuset timer;	// timer and monitor
+	int numa_policy;
 };
 
 static int SIG = 0;
@@ -45,34 +54,33 @@ handle_hup(int signal) {
 #define CHECK_ABORT if (skynet_context_total()==0) break;
 
 static void
-create_thread(pthread_t *thread, void *(*start_routine) (void *), void *arg) {
-	if (pthread_create(thread,NULL, start_routine, arg)) {
-		fprintf(stderr, "Create thread failed");
+create_thread(pthread_t *thread, void *(*start_routine) (void *), void *arg, const struct skynet_cpuset *cpus, int index) {
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	if (skynet_cpuset_bind(&attr, cpus, index)) {
+		fprintf(stderr, "Set thread affinity failed");
 		exit(1);
 	}
-}
-
-static void
-wakeup(struct monitor *m, int busy) {
-	if (m->sleep >= m->count - busy) {
-		// signal sleep worker, "spurious wakeup" is harmless
-		pthread_cond_signal(&m->cond);
+	if (pthread_create(thread,&attr, start_routine, arg)) {
+		fprintf(stderr, "Create thread failed");
+		exit(1);
 	}
+	pthread_attr_destroy(&attr);
 }
 
 static void *
 thread_socket(void *p) {
-	struct monitor * m = p;
+	int shard = (int)(intptr_t)p;
 	skynet_initthread(THREAD_SOCKET);
 	for (;;) {
-		int r = skynet_socket_poll();
+		int r = skynet_socket_poll(shard);
 		if (r==0)
 			break;
 		if (r<0) {
 			CHECK_ABORT
 			continue;
 		}
-		wakeup(m,0);
+		// skynet_mq_push wakes up a parked worker, so don't need wakeup here
 	}
 	return NULL;
 }
@@ -84,8 +92,6 @@ free_monitor(struct monitor *m) {
 	for (i=0;i<n;i++) {
 		skynet_monitor_delete(m->m[i]);
 	}
-	pthread_mutex_destroy(&m->mutex);
-	pthread_cond_destroy(&m->cond);
 	skynet_free(m->m);
 	skynet_free(m);
 }
@@ -99,12 +105,9 @@ thread_monitor(void *p) {
 	for (;;) {
 		CHECK_ABORT
 		for (i=0;i<n;i++) {
-			skynet_monitor_check(m->m[i]);
-		}
-		for (i=0;i<5;i++) {
-			CHECK_ABORT
-			sleep(1);
+			skynet_monitor_check(m->m[i], m->threshold);
 		}
+		usleep(m->interval * 1000);
 	}
 
 	return NULL;
@@ -132,8 +135,7 @@ thread_timer(void *p) {
 	for (;;) {
 		skynet_updatetime();
 		CHECK_ABORT
-		wakeup(m,m->count-1);
-		usleep(2500);
+		skynet_timer_wait();
 		if (SIG) {
 			signal_hup();
 			SIG = 0;
@@ -142,10 +144,8 @@ thread_timer(void *p) {
 	// wakeup socket thread
 	skynet_socket_exit();
 	// wakeup all worker thread
-	pthread_mutex_lock(&m->mutex);
 	m->quit = 1;
-	pthread_cond_broadcast(&m->cond);
-	pthread_mutex_unlock(&m->mutex);
+	skynet_globalmq_quit();
 	return NULL;
 }
 
@@ -158,54 +158,68 @@ thread_worker(void *p) {
 	struct monitor *m = wp->m;
 	struct skynet_monitor *sm = m->m[id];
 	skynet_initthread(THREAD_WORKER);
+	skynet_timer_initthread(id);
+	if (wp->numa_policy != NUMA_POLICY_DEFAULT) {
+		// the per-worker structure is always on the local node
+		skynet_numa_bind(NUMA_POLICY_DEFAULT);
+		skynet_globalmq_initthread(id);
+		skynet_numa_bind(wp->numa_policy);
+	} else {
+		skynet_globalmq_initthread(id);
+	}
 	struct message_queue * q = NULL;
 	while (!m->quit) {
 		q = skynet_context_message_dispatch(sm, q, weight);
-		if (q == NULL) {
-			if (pthread_mutex_lock(&m->mutex) == 0) {
-				++ m->sleep;
-				// "spurious wakeup" is harmless,
-				// because skynet_context_message_dispatch() can be call at any time.
-				if (!m->quit)
-					pthread_cond_wait(&m->cond, &m->mutex);
-				-- m->sleep;
-				if (pthread_mutex_unlock(&m->mutex)) {
-					fprintf(stderr, "unlock mutex error");
-					exit(1);
-				}
-			}
+		if (q == NULL && !m->quit) {
+			// "spurious wakeup" is harmless,
+			// because skynet_context_message_dispatch() can be call at any time.
+			skynet_globalmq_park();
 		}
 	}
 	return NULL;
 }
 
 static void
-start(int thread) {
-	pthread_t pid[thread+3];
+log_layout(struct thread_layout *layout, int thread, int socket_thread) {
+	char buf[256];
+	skynet_error(NULL, "Thread layout : %d socket thread on cpu %s, timer and monitor on cpu %s, numa policy %s",
+		socket_thread,
+		skynet_cpuset_tostring(&layout->socket, -1, buf, sizeof(buf)),
+		skynet_cpuset_tostring(&layout->timer, -1, buf + 128, sizeof(buf) - 128),
+		layout->numa_policy == NUMA_POLICY_INTERLEAVE ? "interleave" : "default");
+	if (layout->worker.n == 0) {
+		skynet_error(NULL, "Thread layout : %d workers on any cpu", thread);
+		return;
+	}
+	int i;
+	for (i=0;i<thread;i++) {
+		skynet_error(NULL, "Thread layout : worker %d on cpu %s", i, skynet_cpuset_tostring(&layout->worker, i, buf, sizeof(buf)));
+	}
+}
+
+static void
+start(int thread, int socket_thread, struct thread_layout *layout, int monitor_interval, int monitor_threshold) {
+	pthread_t pid[thread+socket_thread+2];
 
 	struct monitor *m = skynet_malloc(sizeof(*m));
 	memset(m, 0, sizeof(*m));
 	m->count = thread;
-	m->sleep = 0;
+	m->interval = monitor_interval;
+	m->threshold = monitor_threshold;
 
 	m->m = skynet_malloc(thread * sizeof(struct skynet_monitor *));
 	int i;
 	for (i=0;i<thread;i++) {
 		m->m[i] = skynet_monitor_new();
 	}
-	if (pthread_mutex_init(&m->mutex, NULL)) {
-		fprintf(stderr, "Init mutex error");
-		exit(1);
-	}
-	if (pthread_cond_init(&m->cond, NULL)) {
-		fprintf(stderr, "Init cond error");
-		exit(1);
+	log_layout(layout, thread, socket_thread);
+	create_thread(&pid[0], thread_monitor, m, &layout->timer, -1);
+	create_thread(&pid[1], thread_timer, m, &layout->timer, -1);
+	for (i=0;i<socket_thread;i++) {
+		// pin each one to a cpu of the list when there are more than one socket thread
+		create_thread(&pid[i+2], thread_socket, (void *)(intptr_t)i, &layout->socket, socket_thread > 1 ? i : -1);
 	}
 
-	create_thread(&pid[0], thread_monitor, m);
-	create_thread(&pid[1], thread_timer, m);
-	create_thread(&pid[2], thread_socket, m);
-
 	static int weight[] = { 
 		-1, -1, -1, -1, 0, 0, 0, 0,
 		1, 1, 1, 1, 1, 1, 1, 1, 
@@ -215,15 +229,16 @@ start(int thread) {
 	for (i=0;i<thread;i++) {
 		wp[i].m = m;
 		wp[i].id = i;
+		wp[i].numa_policy = layout->numa_policy;
 		if (i < sizeof(weight)/sizeof(weight[0])) {
 			wp[i].weight= weight[i];
 		} else {
 			wp[i].weight = 0;
 		}
-		create_thread(&pid[i+3], thread_worker, &wp[i]);
+		create_thread(&pid[i+socket_thread+2], thread_worker, &wp[i], &layout->worker, i);
 	}
 
-	for (i=0;i<thread+3;i++) {
+	for (i=0;i<thread+socket_thread+2;i++) {
 		pthread_join(pid[i], NULL); 
 	}
 
@@ -244,6 +259,34 @@ bootstrap(struct skynet_context * logger, const char * cmdline) {
 	}
 }
 
+static void
+init_cpuset(struct skynet_cpuset *set, const char *key, const char *list) {
+	if (skynet_cpuset_parse(set, list) < 0) {
+		fprintf(stderr, "Invalid cpu list %s = %s\n", key, list);
+		exit(1);
+	}
+}
+
+static struct thread_layout *
+init_layout(struct skynet_config * config) {
+	static struct thread_layout layout;
+	init_cpuset(&layout.worker, "thread_affinity", config->thread_affinity);
+	init_cpuset(&layout.socket, "socket_cpu", config->socket_cpu);
+	init_cpuset(&layout.timer, "timer_cpu", config->timer_cpu);
+	layout.numa_policy = skynet_numa_policy(config->numa_policy);
+	if (layout.numa_policy < 0) {
+		fprintf(stderr, "Invalid numa_policy %s\n", config->numa_policy);
+		exit(1);
+	}
+	// All the threads (and the memory they touch first) follow the policy of main thread, except the per-worker structures.
+	// The default policy is the one of the process already, don't touch it.
+	if (layout.numa_policy != NUMA_POLICY_DEFAULT && skynet_numa_bind(layout.numa_policy)) {
+		fprintf(stderr, "Set numa policy %s failed, use the default one\n", config->numa_policy);
+		layout.numa_policy = NUMA_POLICY_DEFAULT;
+	}
+	return &layout;
+}
+
 void 
 skynet_start(struct skynet_config * config) {
 	// register SIGHUP for log file reopen
@@ -258,13 +301,18 @@ skynet_start(struct skynet_config * config) {
 			exit(1);
 		}
 	}
+	struct thread_layout *layout = init_layout(config);
 	skynet_harbor_init(config->harbor);
 	skynet_handle_init(config->harbor);
-	skynet_mq_init();
+	skynet_mq_init(config->thread, config->qwait);
 	skynet_module_init(config->module_path);
-	skynet_timer_init();
-	skynet_socket_init();
+	skynet_timer_init(config->timer_tick, config->timer_catchup_step, config->thread);
+	if (config->socket_thread < 1) {
+		config->socket_thread = 1;
+	}
+	skynet_socket_init(config->socket_thread, config->socket_reuseport);
 	skynet_profile_enable(config->profile);
+	skynet_dispatch_slice(config->dispatch_slice);
 
 	struct skynet_context *ctx = skynet_context_new(config->logservice, config->logger);
 	if (ctx == NULL) {
@@ -274,7 +322,7 @@ skynet_start(struct skynet_config * config) {
 
 	bootstrap(ctx, config->bootstrap);
 
-	start(config->thread);
+	start(config->thread, config->socket_thread, layout, config->monitor_interval, config->monitor_threshold);
 
 	// harbor_exit may call socket send, so it should exit before socket_free
 	skynet_harbor_exit();
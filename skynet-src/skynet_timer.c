@@ -5,12 +5,15 @@
 #include "skynet_server.h"
 #include "skynet_handle.h"
 #include "spinlock.h"
+#include "atomic.h"
 
 #include <time.h>
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
 
 #if defined(__APPLE__)
 #include <AvailabilityMacros.h>
@@ -33,51 +36,175 @@ struct timer_event {
 	int session;
 };
 
+// The lists are circular and doubly linked, so a cancelled node can be unlinked in O(1).
 struct timer_node {
 	struct timer_node *next;
+	struct timer_node *prev;
 	uint32_t expire;
+	uint32_t id;	// in the wheel
+	struct timer_event event;
 };
 
 struct link_list {
 	struct timer_node head;
-	struct timer_node *tail;
 };
 
-struct timer {
+// A pending timer can be found by its id in the slot table (like skynet_handle), the slot is freed when it expires.
+#define TIMER_ID_MASK 0x7fffffff
+#define DEFAULT_TIMER_SLOT_SIZE 1024
+
+// The expired and cancelled nodes are kept in a free list for reuse, at most TIMER_FREE_MAX nodes.
+#define TIMER_FREE_MAX 65536
+
+// The events expired in one tick, sorted by handle to push the messages of each service at once.
+// seq is the expire time relative to now, the events of the same time are in the order of session.
+struct expired_event {
+	uint32_t handle;
+	int session;
+	int seq;
+};
+
+// Each worker thread adds its timers to its own wheel, so skynet_timeout doesn't contend with other workers.
+// Wheel 0 is for the other threads (main, socket, timer).
+// The timer thread shifts all the wheels each tick, and merges the expired events of them.
+struct timer_wheel {
 	struct link_list near[TIME_NEAR];
 	struct link_list t[4][TIME_LEVEL];
 	struct spinlock lock;
-	uint32_t time;
+	uint32_t time;	// in tick
+	int index;
+	struct timer_node **slot;
+	int slot_size;
+	int count;
+	uint32_t id_index;
+	struct timer_node *free_list;
+	int free_count;
+};
+
+// The wheel moves one slot each tick. The tick is 10ms (1 centisecond) by default, and it can be 1, 2 or 5ms.
+// skynet_now and skynet_timeout are always in centisecond.
+
+struct timer {
+	struct timer_wheel **wheel;
+	int wheels;
+	int wheel_bits;	// the timer id is (id in the wheel << wheel_bits | wheel index)
 	uint32_t starttime;
-	uint64_t current;
-	uint64_t current_point;
+	uint64_t current;	// in centisecond
+	uint64_t current_point;	// in tick
+	uint64_t start_cs;	// centisecond in the start second
+	uint64_t elapsed;	// in tick
+	// only used by the timer thread
+	struct expired_event *expired;
+	struct skynet_message *expired_msg;
+	int expired_n;
+	int expired_cap;
+	struct timer_node *overflow;	// expired nodes which don't fit the buffer, see collect_list
+	// lag of the timer thread, in microsecond
+	uint32_t lag_last;
+	uint32_t lag_max;
+	uint32_t stalls;	// updates which miss more than one tick
+	uint32_t jumps;
 };
 
 static struct timer * TI = NULL;
+static int TICK = 10;	// in millisecond
+static int CATCHUP_STEP = 0;	// replay every missed tick instead of jumping
+#define TICK_PER_CS (10 / TICK)
+
+// 0 means the thread is not a worker
+static __thread int WHEEL = 0;
 
+// return the nodes as a NULL terminated list
 static inline struct timer_node *
 link_clear(struct link_list *list) {
-	struct timer_node * ret = list->head.next;
-	list->head.next = 0;
-	list->tail = &(list->head);
+	struct timer_node *head = &list->head;
+	struct timer_node *ret = head->next;
+	if (ret == head) {
+		return NULL;
+	}
+	head->prev->next = NULL;
+	head->next = head->prev = head;
 
 	return ret;
 }
 
+static inline void
+link_init(struct link_list *list) {
+	list->head.next = list->head.prev = &list->head;
+}
+
+static inline int
+link_empty(struct link_list *list) {
+	return list->head.next == &list->head;
+}
+
 static inline void
 link(struct link_list *list,struct timer_node *node) {
-	list->tail->next = node;
-	list->tail = node;
-	node->next=0;
+	struct timer_node *head = &list->head;
+	node->next = head;
+	node->prev = head->prev;
+	head->prev->next = node;
+	head->prev = node;
+}
+
+static inline void
+unlink_node(struct timer_node *node) {
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
 }
 
 static void
-add_node(struct timer *T,struct timer_node *node) {
+expand_slot(struct timer_wheel *W) {
+	int size = W->slot_size * 2;
+	struct timer_node ** new_slot = skynet_malloc(size * sizeof(struct timer_node *));
+	memset(new_slot, 0, size * sizeof(struct timer_node *));
+	int i;
+	for (i=0;i<W->slot_size;i++) {
+		struct timer_node *node = W->slot[i];
+		if (node) {
+			int hash = node->id & (size - 1);
+			assert(new_slot[hash] == NULL);
+			new_slot[hash] = node;
+		}
+	}
+	skynet_free(W->slot);
+	W->slot = new_slot;
+	W->slot_size = size;
+}
+
+static uint32_t
+alloc_id(struct timer_wheel *W, struct timer_node *node) {
+	// keep the load factor under 1/2, so the probe is short
+	if (W->count * 2 >= W->slot_size) {
+		expand_slot(W);
+	}
+	for (;;) {
+		uint32_t id = W->id_index & (TIMER_ID_MASK >> TI->wheel_bits);
+		W->id_index = id + 1;
+		int hash = id & (W->slot_size - 1);
+		if (id != 0 && W->slot[hash] == NULL) {
+			W->slot[hash] = node;
+			++W->count;
+			return id;
+		}
+	}
+}
+
+static inline void
+free_id(struct timer_wheel *W, struct timer_node *node) {
+	int hash = node->id & (W->slot_size - 1);
+	assert(W->slot[hash] == node);
+	W->slot[hash] = NULL;
+	--W->count;
+}
+
+static void
+add_node(struct timer_wheel *W,struct timer_node *node) {
 	uint32_t time=node->expire;
-	uint32_t current_time=T->time;
+	uint32_t current_time=W->time;
 	
 	if ((time|TIME_NEAR_MASK)==(current_time|TIME_NEAR_MASK)) {
-		link(&T->near[time&TIME_NEAR_MASK],node);
+		link(&W->near[time&TIME_NEAR_MASK],node);
 	} else {
 		int i;
 		uint32_t mask=TIME_NEAR << TIME_LEVEL_SHIFT;
@@ -88,39 +215,63 @@ add_node(struct timer *T,struct timer_node *node) {
 			mask <<= TIME_LEVEL_SHIFT;
 		}
 
-		link(&T->t[i][((time>>(TIME_NEAR_SHIFT + i*TIME_LEVEL_SHIFT)) & TIME_LEVEL_MASK)],node);	
+		link(&W->t[i][((time>>(TIME_NEAR_SHIFT + i*TIME_LEVEL_SHIFT)) & TIME_LEVEL_MASK)],node);	
 	}
 }
 
-static void
-timer_add(struct timer *T,void *arg,size_t sz,int time) {
-	struct timer_node *node = (struct timer_node *)skynet_malloc(sizeof(*node)+sz);
-	memcpy(node+1,arg,sz);
-
-	SPIN_LOCK(T);
-
-		node->expire=time+T->time;
-		add_node(T,node);
+// with lock
+static inline void
+free_node(struct timer_wheel *W, struct timer_node *node) {
+	if (W->free_count < TIMER_FREE_MAX) {
+		node->next = W->free_list;
+		W->free_list = node;
+		++W->free_count;
+	} else {
+		skynet_free(node);
+	}
+}
 
-	SPIN_UNLOCK(T);
+static uint32_t
+timer_add(struct timer *T,uint32_t handle,int session,uint32_t time) {
+	struct timer_wheel *W = T->wheel[WHEEL];
+	SPIN_LOCK(W);
+
+		struct timer_node *node = W->free_list;
+		if (node) {
+			W->free_list = node->next;
+			--W->free_count;
+		} else {
+			SPIN_UNLOCK(W);
+			node = (struct timer_node *)skynet_malloc(sizeof(*node));
+			SPIN_LOCK(W);
+		}
+		node->event.handle = handle;
+		node->event.session = session;
+		node->expire=time+W->time;
+		node->id = alloc_id(W, node);
+		add_node(W,node);
+		uint32_t id = node->id << T->wheel_bits | W->index;
+
+	SPIN_UNLOCK(W);
+	return id;
 }
 
 static void
-move_list(struct timer *T, int level, int idx) {
-	struct timer_node *current = link_clear(&T->t[level][idx]);
+move_list(struct timer_wheel *W, int level, int idx) {
+	struct timer_node *current = link_clear(&W->t[level][idx]);
 	while (current) {
 		struct timer_node *temp=current->next;
-		add_node(T,current);
+		add_node(W,current);
 		current=temp;
 	}
 }
 
 static void
-timer_shift(struct timer *T) {
+timer_shift(struct timer_wheel *W) {
 	int mask = TIME_NEAR;
-	uint32_t ct = ++T->time;
+	uint32_t ct = ++W->time;
 	if (ct == 0) {
-		move_list(T, 3, 0);
+		move_list(W, 3, 0);
 	} else {
 		uint32_t time = ct >> TIME_NEAR_SHIFT;
 		int i=0;
@@ -128,7 +279,7 @@ timer_shift(struct timer *T) {
 		while ((ct & (mask-1))==0) {
 			int idx=time & TIME_LEVEL_MASK;
 			if (idx!=0) {
-				move_list(T, i, idx);
+				move_list(W, i, idx);
 				break;				
 			}
 			mask <<= TIME_LEVEL_SHIFT;
@@ -138,78 +289,281 @@ timer_shift(struct timer *T) {
 	}
 }
 
+static int
+expired_compar(const void *a, const void *b) {
+	const struct expired_event *ea = a;
+	const struct expired_event *eb = b;
+	if (ea->handle != eb->handle)
+		return ea->handle < eb->handle ? -1 : 1;
+	if (ea->seq != eb->seq)
+		return ea->seq < eb->seq ? -1 : 1;
+	// the session of a service increases (and wraps around)
+	return (int32_t)((uint32_t)ea->session - (uint32_t)eb->session) < 0 ? -1 : 1;
+}
+
+static void
+expired_reserve(struct timer *T, int n) {
+	if (n <= T->expired_cap)
+		return;
+	int cap = T->expired_cap ? T->expired_cap : 64;
+	while (cap < n) {
+		cap *= 2;
+	}
+	T->expired = skynet_realloc(T->expired, cap * sizeof(struct expired_event));
+	skynet_free(T->expired_msg);
+	T->expired_msg = skynet_malloc(cap * sizeof(struct skynet_message));
+	T->expired_cap = cap;
+}
+
 static inline void
-dispatch_list(struct timer_node *current) {
-	do {
-		struct timer_event * event = (struct timer_event *)(current+1);
-		struct skynet_message message;
-		message.source = 0;
-		message.session = event->session;
-		message.data = NULL;
-		message.sz = (size_t)PTYPE_RESPONSE << MESSAGE_TYPE_SHIFT;
+expired_event(struct timer *T, struct timer_wheel *W, struct timer_node *node) {
+	struct expired_event *e = &T->expired[T->expired_n++];
+	e->handle = node->event.handle;
+	e->session = node->event.session;
+	e->seq = (int32_t)(node->expire - W->time);
+}
 
-		skynet_context_push(event->handle, &message);
-		
-		struct timer_node * temp = current;
-		current=current->next;
-		skynet_free(temp);	
-	} while (current);
+// with the lock of W, take the events of the expired nodes and give back the nodes.
+// The buffer is never resized with the lock (skynet_timeout and skynet_timer_cancel spin on it),
+// when it's too small, the nodes are kept in T->overflow for collect_overflow after unlock.
+static void
+collect_list(struct timer *T, struct timer_wheel *W, struct timer_node *current) {
+	int n = T->expired_n;
+	struct timer_node *node;
+	struct timer_node *last = NULL;
+	for (node = current; node; node = node->next) {
+		// they can't be cancelled any more
+		free_id(W, node);
+		last = node;
+		++n;
+	}
+	if (last == NULL)
+		return;
+	if (T->overflow || n > T->expired_cap) {
+		last->next = T->overflow;
+		T->overflow = current;
+		return;
+	}
+	while (current) {
+		node = current;
+		current = current->next;
+		expired_event(T, W, node);
+		free_node(W, node);
+	}
+}
+
+// without the lock of W, W->time is changed only by the timer thread.
+static void
+collect_overflow(struct timer *T, struct timer_wheel *W) {
+	struct timer_node *current = T->overflow;
+	if (current == NULL)
+		return;
+	T->overflow = NULL;
+	int n = T->expired_n;
+	struct timer_node *node;
+	for (node = current; node; node = node->next) {
+		++n;
+	}
+	expired_reserve(T, n);
+	for (node = current; node; node = node->next) {
+		expired_event(T, W, node);
+	}
+	SPIN_LOCK(W);
+	while (current) {
+		node = current;
+		current = current->next;
+		free_node(W, node);
+	}
+	SPIN_UNLOCK(W);
+}
+
+// Push the expired events to the services, the messages of each service are pushed at once.
+static void
+dispatch_expired(struct timer *T) {
+	int n = T->expired_n;
+	if (n == 0)
+		return;
+	T->expired_n = 0;
+	struct expired_event *e = T->expired;
+	if (n > 1) {
+		qsort(e, n, sizeof(*e), expired_compar);
+	}
+	struct skynet_message *msg = T->expired_msg;
+	int from = 0;
+	int i;
+	for (i=0;i<n;i++) {
+		msg[i].source = 0;
+		msg[i].session = e[i].session;
+		msg[i].data = NULL;
+		msg[i].sz = (size_t)PTYPE_RESPONSE << MESSAGE_TYPE_SHIFT;
+		if (i == n - 1 || e[i+1].handle != e[from].handle) {
+			skynet_context_push_batch(e[from].handle, msg + from, i + 1 - from);
+			from = i + 1;
+		}
+	}
 }
 
 static inline void
-timer_execute(struct timer *T) {
-	int idx = T->time & TIME_NEAR_MASK;
-	
-	while (T->near[idx].head.next) {
-		struct timer_node *current = link_clear(&T->near[idx]);
-		SPIN_UNLOCK(T);
-		// dispatch_list don't need lock T
-		dispatch_list(current);
-		SPIN_LOCK(T);
+timer_execute(struct timer *T, struct timer_wheel *W) {
+	int idx = W->time & TIME_NEAR_MASK;
+	struct timer_node *current = link_clear(&W->near[idx]);
+	if (current) {
+		collect_list(T, W, current);
+	}
+}
+
+static struct timer_node *
+take_list(struct link_list *list, struct timer_node *all) {
+	struct timer_node *current = link_clear(list);
+	if (current == NULL)
+		return all;
+	struct timer_node *last = current;
+	while (last->next) {
+		last = last->next;
 	}
+	last->next = all;
+	return current;
+}
+
+// take the n slots after idx (idx itself with self), the slots are circular.
+static struct timer_node *
+take_slots(struct link_list *list, uint32_t size, int idx, uint32_t n, int self, struct timer_node *all) {
+	if (n >= size) {
+		n = size;
+		self = 0;
+	}
+	uint32_t i;
+	if (self) {
+		all = take_list(&list[idx], all);
+	}
+	for (i=1;i<=n;i++) {
+		all = take_list(&list[(idx + i) & (size - 1)], all);
+	}
+	return all;
+}
+
+// After a long stall, move time forward at once instead of shifting the wheels tick by tick.
+// Each level is cascaded once : only the slots passed by the time of that level are taken out,
+// the overdue nodes in them are dispatched together (in the order of expire time) and the others are added again.
+// So the cost is the number of passed slots (at most TIME_NEAR + 4 * TIME_LEVEL) plus the nodes in them,
+// the later timers are not touched.
+// There is no periodic timer in the wheel, skynet.timeout re-arms from the current time in Lua,
+// so a timer which missed several periods fires once after the jump : they are coalesced.
+static void
+timer_jump(struct timer *T, uint32_t diff) {
+	int w;
+	for (w=0;w<T->wheels;w++) {
+		struct timer_wheel *W = T->wheel[w];
+		SPIN_LOCK(W);
+
+		uint32_t from = W->time;
+		uint32_t to = from + diff;
+		// the current near slot is taken too, for timeout 0 (see timer_update)
+		struct timer_node *all = take_slots(W->near, TIME_NEAR, from & TIME_NEAR_MASK, diff, 1, NULL);
+		int i;
+		for (i=0;i<4;i++) {
+			int shift = TIME_NEAR_SHIFT + i * TIME_LEVEL_SHIFT;
+			uint32_t n = (to >> shift) - (from >> shift);
+			if (n == 0)
+				break;
+			all = take_slots(W->t[i], TIME_LEVEL, (from >> shift) & TIME_LEVEL_MASK, n, 0, all);
+		}
+
+		W->time = to;
+		struct timer_node *expired = NULL;
+		struct timer_node **tail = &expired;
+		while (all) {
+			struct timer_node *node = all;
+			all = all->next;
+			if ((int32_t)(node->expire - W->time) <= 0) {
+				*tail = node;
+				tail = &node->next;
+			} else {
+				add_node(W, node);
+			}
+		}
+		*tail = NULL;
+		collect_list(T, W, expired);
+
+		SPIN_UNLOCK(W);
+		collect_overflow(T, W);
+	}
+
+	dispatch_expired(T);
 }
 
 static void 
 timer_update(struct timer *T) {
-	SPIN_LOCK(T);
+	int i;
+	for (i=0;i<T->wheels;i++) {
+		struct timer_wheel *W = T->wheel[i];
+		SPIN_LOCK(W);
 
-	// try to dispatch timeout 0 (rare condition)
-	timer_execute(T);
+		// try to dispatch timeout 0 (rare condition)
+		timer_execute(T, W);
 
-	// shift time first, and then dispatch timer message
-	timer_shift(T);
+		// shift time first, and then dispatch timer message
+		timer_shift(W);
 
-	timer_execute(T);
+		timer_execute(T, W);
 
-	SPIN_UNLOCK(T);
+		SPIN_UNLOCK(W);
+		collect_overflow(T, W);
+	}
+	// dispatch_expired don't need lock W
+	dispatch_expired(T);
 }
 
-static struct timer *
-timer_create_timer() {
-	struct timer *r=(struct timer *)skynet_malloc(sizeof(struct timer));
+static struct timer_wheel *
+timer_create_wheel(int index) {
+	struct timer_wheel *r=(struct timer_wheel *)skynet_malloc(sizeof(struct timer_wheel));
 	memset(r,0,sizeof(*r));
 
 	int i,j;
 
 	for (i=0;i<TIME_NEAR;i++) {
-		link_clear(&r->near[i]);
+		link_init(&r->near[i]);
 	}
 
 	for (i=0;i<4;i++) {
 		for (j=0;j<TIME_LEVEL;j++) {
-			link_clear(&r->t[i][j]);
+			link_init(&r->t[i][j]);
 		}
 	}
 
 	SPIN_INIT(r)
 
+	r->index = index;
+	r->slot_size = DEFAULT_TIMER_SLOT_SIZE;
+	r->slot = skynet_malloc(r->slot_size * sizeof(struct timer_node *));
+	memset(r->slot, 0, r->slot_size * sizeof(struct timer_node *));
+	r->count = 0;
+	r->id_index = 1;
+
+	return r;
+}
+
+static struct timer *
+timer_create_timer(int worker) {
+	struct timer *r=(struct timer *)skynet_malloc(sizeof(struct timer));
+	memset(r,0,sizeof(*r));
+
+	r->wheels = worker + 1;
+	while ((1 << r->wheel_bits) < r->wheels) {
+		++r->wheel_bits;
+	}
+	r->wheel = skynet_malloc(r->wheels * sizeof(struct timer_wheel *));
+	int i;
+	for (i=0;i<r->wheels;i++) {
+		r->wheel[i] = timer_create_wheel(i);
+	}
 	r->current = 0;
 
 	return r;
 }
 
-int
-skynet_timeout(uint32_t handle, int time, int session) {
+static int
+timeout_tick(uint32_t handle, int64_t time, int session) {
 	if (time <= 0) {
 		struct skynet_message message;
 		message.source = 0;
@@ -220,14 +574,23 @@ skynet_timeout(uint32_t handle, int time, int session) {
 		if (skynet_context_push(handle, &message)) {
 			return -1;
 		}
+		return 0;
 	} else {
-		struct timer_event event;
-		event.handle = handle;
-		event.session = session;
-		timer_add(TI, &event, sizeof(event), time);
+		if (time > INT32_MAX) {
+			time = INT32_MAX;
+		}
+		return (int)timer_add(TI, handle, session, (uint32_t)time);
 	}
+}
+
+int
+skynet_timeout(uint32_t handle, int time, int session) {
+	return timeout_tick(handle, (int64_t)time * TICK_PER_CS, session);
+}
 
-	return session;
+int
+skynet_timeout_ms(uint32_t handle, int time, int session) {
+	return timeout_tick(handle, ((int64_t)time + TICK - 1) / TICK, session);
 }
 
 // millisecond: 1/1000 second
@@ -279,40 +642,123 @@ systime(uint32_t *sec, uint32_t *cs) {
 #endif
 }
 
+// in microsecond
 static uint64_t
-gettime() {
+gettime_us() {
 	uint64_t t;
 #if !defined(__APPLE__) || defined(AVAILABLE_MAC_OS_X_VERSION_10_12_AND_LATER)
 	struct timespec ti;
 	clock_gettime(CLOCK_MONOTONIC, &ti);
-	t = (uint64_t)ti.tv_sec * 100;
-	t += ti.tv_nsec / 10000000;
+	t = (uint64_t)ti.tv_sec * 1000000;
+	t += ti.tv_nsec / 1000;
 #else
 	struct timeval tv;
 	gettimeofday(&tv, NULL);
-	t = (uint64_t)tv.tv_sec * 100;
-	t += tv.tv_usec / 10000;
+	t = (uint64_t)tv.tv_sec * 1000000;
+	t += tv.tv_usec;
 #endif
 	return t;
 }
 
+// in tick
+static inline uint64_t
+gettime() {
+	return gettime_us() / (TICK * 1000);
+}
+
+// The lag is how late the first missed tick is updated.
+static void
+record_lag(struct timer *T, uint64_t now_us, uint32_t diff) {
+	uint64_t expect = (T->current_point + 1) * TICK * 1000;
+	uint32_t lag = now_us > expect ? (uint32_t)(now_us - expect) : 0;
+	// They are read (and lag_max is reset) by skynet_timer_lag in a worker thread.
+	ATOM_STORE(&T->lag_last, lag);
+	uint32_t max = ATOM_LOAD(&T->lag_max);
+	while (lag > max && !ATOM_CAS(&T->lag_max, max, lag)) {
+		max = ATOM_LOAD(&T->lag_max);
+	}
+	if (diff > 1) {
+		ATOM_INC(&T->stalls);
+	}
+}
+
 void
 skynet_updatetime(void) {
-	uint64_t cp = gettime();
+	uint64_t now = gettime_us();
+	uint64_t cp = now / (TICK * 1000);
 	if(cp < TI->current_point) {
 		skynet_error(NULL, "time diff error: change from %lld to %lld", cp, TI->current_point);
 		TI->current_point = cp;
 	} else if (cp != TI->current_point) {
 		uint32_t diff = (uint32_t)(cp - TI->current_point);
+		record_lag(TI, now, diff);
 		TI->current_point = cp;
-		TI->current += diff;
-		int i;
-		for (i=0;i<diff;i++) {
-			timer_update(TI);
+		TI->elapsed += diff;
+		TI->current = TI->start_cs + TI->elapsed / TICK_PER_CS;
+		if (diff >= TIME_NEAR && !CATCHUP_STEP) {
+			ATOM_INC(&TI->jumps);
+			skynet_error(NULL, "Timer stalls for %u ms, jump forward", diff * TICK);
+			timer_jump(TI, diff);
+		} else {
+			int i;
+			for (i=0;i<diff;i++) {
+				timer_update(TI);
+			}
 		}
 	}
 }
 
+void
+skynet_timer_lag(uint32_t *last, uint32_t *max, uint32_t *stalls, uint32_t *jumps) {
+	*last = ATOM_LOAD(&TI->lag_last);
+	*max = ATOM_SWAP(&TI->lag_max, 0);
+	*stalls = ATOM_LOAD(&TI->stalls);
+	*jumps = ATOM_LOAD(&TI->jumps);
+}
+
+// Sleep until the next tick by absolute deadline of the monotonic clock, so it neither drifts nor polls.
+void
+skynet_timer_wait(void) {
+#if defined(__linux__)
+	uint64_t next = (TI->current_point + 1) * TICK;	// in millisecond
+	struct timespec ti;
+	ti.tv_sec = next / 1000;
+	ti.tv_nsec = (next % 1000) * 1000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ti, NULL) == EINTR) {}
+#else
+	// poll 4 times each tick
+	struct timespec ti;
+	ti.tv_sec = 0;
+	ti.tv_nsec = TICK * 250000;
+	nanosleep(&ti, NULL);
+#endif
+}
+
+int
+skynet_timer_cancel(uint32_t handle, int id) {
+	if (id <= 0) {
+		return 0;
+	}
+	struct timer *T = TI;
+	int index = id & ((1 << T->wheel_bits) - 1);
+	if (index >= T->wheels) {
+		return 0;
+	}
+	uint32_t wid = (uint32_t)id >> T->wheel_bits;
+	struct timer_wheel *W = T->wheel[index];
+	int ret = 0;
+	SPIN_LOCK(W);
+	struct timer_node *n = W->slot[wid & (W->slot_size - 1)];
+	if (n && n->id == wid && n->event.handle == handle) {
+		unlink_node(n);
+		free_id(W, n);
+		free_node(W, n);
+		ret = 1;
+	}
+	SPIN_UNLOCK(W);
+	return ret;
+}
+
 uint32_t
 skynet_starttime(void) {
 	return TI->starttime;
@@ -323,11 +769,25 @@ skynet_now(void) {
 	return TI->current;
 }
 
+void
+skynet_timer_initthread(int worker) {
+	assert(worker >= 0 && worker + 1 < TI->wheels);
+	WHEEL = worker + 1;
+}
+
 void 
-skynet_timer_init(void) {
-	TI = timer_create_timer();
+skynet_timer_init(int tick, int catchup_step, int worker) {
+	CATCHUP_STEP = catchup_step;
+	if (tick != 1 && tick != 2 && tick != 5 && tick != 10) {
+		fprintf(stderr, "Invalid timer_tick %d, it should be 1, 2, 5 or 10\n", tick);
+		exit(1);
+	}
+	TICK = tick;
+	TI = timer_create_timer(worker);
 	uint32_t current = 0;
 	systime(&TI->starttime, &current);
+	TI->start_cs = current;
+	TI->elapsed = 0;
 	TI->current = current;
 	TI->current_point = gettime();
 }
@@ -3,12 +3,23 @@
 
 #include <stdint.h>
 
-int skynet_timeout(uint32_t handle, int time, int session);
+// return the timer id, 0 when the time is up already (the message is pushed), -1 for error
+int skynet_timeout(uint32_t handle, int time, int session);	// in centisecond
+int skynet_timeout_ms(uint32_t handle, int time, int session);	// in millisecond, round up to the tick
+// return 1 if the timer is removed, 0 if it has expired (the message may be in the queue of handle) or it's not owned by handle
+int skynet_timer_cancel(uint32_t handle, int id);
 void skynet_updatetime(void);
+void skynet_timer_wait(void);	// sleep until the next tick
 uint32_t skynet_starttime(void);
 uint64_t skynet_thread_time(void);	// for profile, in micro second
 
-void skynet_timer_init(void);
+// lag in microsecond, max is reset on read. stalls : the updates miss more than one tick. jumps : see timer_catchup in config
+void skynet_timer_lag(uint32_t *last, uint32_t *max, uint32_t *stalls, uint32_t *jumps);
+
+// tick in millisecond : 1, 2, 5 or 10. catchup_step : replay every missed tick after a stall, instead of jumping
+// worker : the number of worker threads, each worker has its own timer wheel
+void skynet_timer_init(int tick, int catchup_step, int worker);
+void skynet_timer_initthread(int worker);	// call it in the worker thread, the timers it adds go to its own wheel
 
 void systime_ms(uint32_t *sec, uint32_t *ms);
 uint64_t gettime_ms();
@@ -7,6 +7,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <errno.h>
@@ -16,6 +17,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
 
 #define MAX_INFO 128
 // MAX_SOCKET will be 2^MAX_SOCKET_P
@@ -58,6 +60,19 @@
 
 #define WARNING_SIZE (1024*1024)
 
+// The receive buffers are cached in size classes of 2^6 (MIN_READ_BUFFER) to 2^16 bytes
+#define POOL_CLASS_MIN 6
+#define POOL_CLASS_MAX 16
+#define POOL_CLASS (POOL_CLASS_MAX - POOL_CLASS_MIN + 1)
+#define POOL_CACHE (1024 * 1024)	// bytes cached in each class at most
+
+// max buffers gathered in one writev
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define MAX_IOV IOV_MAX
+#else
+#define MAX_IOV 1024
+#endif
+
 struct write_buffer {
 	struct write_buffer * next;
 	void *buffer;
@@ -85,34 +100,46 @@ struct socket {
 	int id;
 	uint8_t protocol;
 	uint8_t type;
+	uint8_t batch;	// the SOCKET_DATA can be batched by the caller, see socket_server_isbatch
 	uint16_t udpconnecting;
 	int64_t warn_size;
 	union {
 		int size;
 		uint8_t udp_address[UDP_ADDRESS_SIZE];
 	} p;
+	int sibling;	// the listen socket of the same port in the next shard (SO_REUSEPORT), or -1
+	int listen_id;	// the id reported by the accept of the sibling listen sockets
 	struct spinlock dw_lock;
 	int dw_offset;
 	const void * dw_buffer;
 	size_t dw_size;
 };
 
-struct socket_server {
+// Each shard is polled by one socket thread, it owns the sockets whose slot index % shard_n is the shard index.
+// The ctrl commands of a socket are sent to the pipe of its shard, so only the owner thread changes the socket.
+struct socket_shard {
 	int recvctrl_fd;
 	int sendctrl_fd;
 	int checkctrl;
+	int idle;	// the end of events has been reported to the caller
 	poll_fd event_fd;
-	int alloc_id;
 	int event_n;
 	int event_index;
-	struct socket_object_interface soi;
 	struct event ev[MAX_EVENT];
-	struct socket slot[MAX_SOCKET];
 	char buffer[MAX_INFO];
 	uint8_t udpbuffer[MAX_UDP_PACKAGE];
 	fd_set rfds;
 };
 
+struct socket_server {
+	int alloc_id;
+	int shard_n;
+	bool reuseport;
+	struct socket_object_interface soi;
+	struct socket_shard * shard;
+	struct socket slot[MAX_SOCKET];
+};
+
 struct request_open {
 	int id;
 	int port;
@@ -145,6 +172,8 @@ struct request_close {
 struct request_listen {
 	int id;
 	int fd;
+	int sibling;
+	int listen_id;
 	uintptr_t opaque;
 	char host[1];
 };
@@ -184,8 +213,10 @@ struct request_udp {
 	X Exit
 	D Send package (high)
 	P Send package (low)
+	W Enable write (after a direct write in other thread)
 	A Send UDP package
 	T Set opt
+	G Set batch
 	U Create UDP socket
 	C set udp address
  */
@@ -223,6 +254,104 @@ struct send_object {
 #define MALLOC skynet_malloc
 #define FREE skynet_free
 
+/*
+	The data of SOCKET_DATA and SOCKET_UDP is allocated from the receive buffer pool.
+	A buffer of size class c is a block of MALLOC(1 << c), and the class is kept in the POOL_HEADER bytes in front of the data,
+	so socket_server_free_data returns it to the right pool whatever the size of data is.
+	The class of a buffer larger than 1 << POOL_CLASS_MAX is 0, it's not cached.
+ */
+
+#define POOL_HEADER 8
+
+struct pool_class {
+	struct spinlock lock;
+	void * head;	// the first word of a free block is the next one
+	int count;
+	uint64_t alloc;
+	uint64_t reuse;
+	uint64_t release;
+};
+
+static struct pool_class POOL[POOL_CLASS];
+
+static inline int
+pool_class(int sz) {
+	int c = POOL_CLASS_MIN;
+	while ((1 << c) < sz) {
+		++c;
+	}
+	return c;
+}
+
+static inline void *
+pool_data(void * block, int c) {
+	*(int *)block = c;
+	return (char *)block + POOL_HEADER;
+}
+
+// sz is the size of data, the block is POOL_HEADER bytes larger
+static void *
+pool_alloc(int sz) {
+	if (sz > (1 << POOL_CLASS_MAX) - POOL_HEADER) {
+		return pool_data(MALLOC(sz + POOL_HEADER), 0);
+	}
+	int c = pool_class(sz + POOL_HEADER);
+	struct pool_class *pc = &POOL[c - POOL_CLASS_MIN];
+	spinlock_lock(&pc->lock);
+	void * block = pc->head;
+	if (block) {
+		pc->head = *(void **)block;
+		--pc->count;
+		++pc->reuse;
+		spinlock_unlock(&pc->lock);
+		return pool_data(block, c);
+	}
+	++pc->alloc;
+	spinlock_unlock(&pc->lock);
+	return pool_data(MALLOC(1 << c), c);
+}
+
+// sz is not used, the class of the buffer is in its header.
+void
+socket_server_free_data(void * data, int sz) {
+	(void)sz;
+	if (data == NULL)
+		return;
+	void * block = (char *)data - POOL_HEADER;
+	int c = *(int *)block;
+	if (c == 0) {
+		FREE(block);
+		return;
+	}
+	struct pool_class *pc = &POOL[c - POOL_CLASS_MIN];
+	spinlock_lock(&pc->lock);
+	if (pc->count < (POOL_CACHE >> c)) {
+		*(void **)block = pc->head;
+		pc->head = block;
+		++pc->count;
+		++pc->release;
+		spinlock_unlock(&pc->lock);
+		return;
+	}
+	spinlock_unlock(&pc->lock);
+	FREE(block);
+}
+
+void
+socket_server_buffer_stat(struct socket_buffer_stat *stat) {
+	memset(stat, 0, sizeof(*stat));
+	int i;
+	for (i=0;i<POOL_CLASS;i++) {
+		struct pool_class *pc = &POOL[i];
+		spinlock_lock(&pc->lock);
+		stat->alloc += pc->alloc;
+		stat->reuse += pc->reuse;
+		stat->release += pc->release;
+		stat->cached += (uint64_t)pc->count << (i + POOL_CLASS_MIN);
+		spinlock_unlock(&pc->lock);
+	}
+}
+
 struct socket_lock {
 	struct spinlock *lock;
 	int count;
@@ -292,14 +421,29 @@ socket_keepalive(int fd) {
 	setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (void *)&keepalive , sizeof(keepalive));  
 }
 
+static inline int
+shard_index(struct socket_server *ss, int id) {
+	return HASH_ID(id) % ss->shard_n;
+}
+
+static inline struct socket_shard *
+socket_shard(struct socket_server *ss, int id) {
+	return &ss->shard[shard_index(ss, id)];
+}
+
+// shard < 0 means any shard. Only one of shard_n ids is in the shard, so it tries MAX_SOCKET * shard_n ids at most.
 static int
-reserve_id(struct socket_server *ss) {
+reserve_id_shard(struct socket_server *ss, int shard) {
 	int i;
-	for (i=0;i<MAX_SOCKET;i++) {
+	int n = shard >= 0 ? MAX_SOCKET * ss->shard_n : MAX_SOCKET;
+	for (i=0;i<n;i++) {
 		int id = ATOM_INC(&(ss->alloc_id));
 		if (id < 0) {
 			id = ATOM_AND(&(ss->alloc_id), 0x7fffffff);
 		}
+		if (shard >= 0 && shard_index(ss, id) != shard) {
+			continue;
+		}
 		struct socket *s = &ss->slot[HASH_ID(id)];
 		if (s->type == SOCKET_TYPE_INVALID) {
 			if (ATOM_CAS(&s->type, SOCKET_TYPE_INVALID, SOCKET_TYPE_RESERVE)) {
@@ -319,25 +463,29 @@ reserve_id(struct socket_server *ss) {
 	return -1;
 }
 
+static inline int
+reserve_id(struct socket_server *ss) {
+	return reserve_id_shard(ss, -1);
+}
+
 static inline void
 clear_wb_list(struct wb_list *list) {
 	list->head = NULL;
 	list->tail = NULL;
 }
 
-struct socket_server * 
-socket_server_create() {
-	int i;
+static int
+shard_init(struct socket_shard *sd) {
 	int fd[2];
 	poll_fd efd = sp_create();
 	if (sp_invalid(efd)) {
 		fprintf(stderr, "socket-server: create event pool failed.\n");
-		return NULL;
+		return 1;
 	}
 	if (pipe(fd)) {
 		sp_release(efd);
 		fprintf(stderr, "socket-server: create socket pair failed.\n");
-		return NULL;
+		return 1;
 	}
 	if (sp_add(efd, fd[0], NULL)) {
 		// add recvctrl_fd to event poll
@@ -345,14 +493,61 @@ socket_server_create() {
 		close(fd[0]);
 		close(fd[1]);
 		sp_release(efd);
-		return NULL;
+		return 1;
+	}
+	sd->event_fd = efd;
+	sd->recvctrl_fd = fd[0];
+	sd->sendctrl_fd = fd[1];
+	sd->checkctrl = 1;
+	sd->idle = 0;
+	sd->event_n = 0;
+	sd->event_index = 0;
+	FD_ZERO(&sd->rfds);
+	assert(sd->recvctrl_fd < FD_SETSIZE);
+	return 0;
+}
+
+static void
+shard_release(struct socket_shard *sd) {
+	close(sd->sendctrl_fd);
+	close(sd->recvctrl_fd);
+	sp_release(sd->event_fd);
+}
+
+struct socket_server * 
+socket_server_create() {
+	return socket_server_create_shards(1, 0);
+}
+
+struct socket_server *
+socket_server_create_shards(int n, int reuseport) {
+	int i;
+	if (n < 1) {
+		n = 1;
+	}
+	struct socket_shard *shard = MALLOC(n * sizeof(*shard));
+	for (i=0;i<n;i++) {
+		if (shard_init(&shard[i])) {
+			while (--i >= 0) {
+				shard_release(&shard[i]);
+			}
+			FREE(shard);
+			return NULL;
+		}
+	}
+
+	for (i=0;i<POOL_CLASS;i++) {
+		spinlock_init(&POOL[i].lock);
 	}
 
 	struct socket_server *ss = MALLOC(sizeof(*ss));
-	ss->event_fd = efd;
-	ss->recvctrl_fd = fd[0];
-	ss->sendctrl_fd = fd[1];
-	ss->checkctrl = 1;
+	ss->shard_n = n;
+	ss->shard = shard;
+#ifdef SO_REUSEPORT
+	ss->reuseport = reuseport != 0;
+#else
+	ss->reuseport = false;
+#endif
 
 	for (i=0;i<MAX_SOCKET;i++) {
 		struct socket *s = &ss->slot[i];
@@ -361,11 +556,7 @@ socket_server_create() {
 		clear_wb_list(&s->low);
 	}
 	ss->alloc_id = 0;
-	ss->event_n = 0;
-	ss->event_index = 0;
 	memset(&ss->soi, 0, sizeof(ss->soi));
-	FD_ZERO(&ss->rfds);
-	assert(ss->recvctrl_fd < FD_SETSIZE);
 
 	return ss;
 }
@@ -389,6 +580,24 @@ free_buffer(struct socket_server *ss, const void * buffer, int sz) {
 	so.free_func((void *)buffer);
 }
 
+static inline void 
+clear_closed_event(struct socket_shard *sd, struct socket_message * result, int type) {
+	if (type == SOCKET_CLOSE || type == SOCKET_ERR) {
+		int id = result->id;
+		int i;
+		for (i=sd->event_index; i<sd->event_n; i++) {
+			struct event *e = &sd->ev[i];
+			struct socket *s = e->s;
+			if (s) {
+				if (s->type == SOCKET_TYPE_INVALID && s->id == id) {
+					e->s = NULL;
+					break;
+				}
+			}
+		}
+	}
+}
+
 static void
 force_close(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
 	result->id = s->id;
@@ -402,7 +611,7 @@ force_close(struct socket_server *ss, struct socket *s, struct socket_lock *l, s
 	free_wb_list(ss,&s->high);
 	free_wb_list(ss,&s->low);
 	if (s->type != SOCKET_TYPE_PACCEPT && s->type != SOCKET_TYPE_PLISTEN) {
-		sp_del(ss->event_fd, s->fd);
+		sp_del(socket_shard(ss, s->id)->event_fd, s->fd);
 	}
 	socket_lock(l);
 	if (s->type != SOCKET_TYPE_BIND) {
@@ -430,9 +639,10 @@ socket_server_release(struct socket_server *ss) {
 			force_close(ss, s, &l, &dummy);
 		}
 	}
-	close(ss->sendctrl_fd);
-	close(ss->recvctrl_fd);
-	sp_release(ss->event_fd);
+	for (i=0;i<ss->shard_n;i++) {
+		shard_release(&ss->shard[i]);
+	}
+	FREE(ss->shard);
 	FREE(ss);
 }
 
@@ -448,7 +658,7 @@ new_fd(struct socket_server *ss, int id, int fd, int protocol, uintptr_t opaque,
 	assert(s->type == SOCKET_TYPE_RESERVE);
 
 	if (add) {
-		if (sp_add(ss->event_fd, fd, s)) {
+		if (sp_add(socket_shard(ss, id)->event_fd, fd, s)) {
 			s->type = SOCKET_TYPE_INVALID;
 			return NULL;
 		}
@@ -467,6 +677,9 @@ new_fd(struct socket_server *ss, int id, int fd, int protocol, uintptr_t opaque,
 	spinlock_init(&s->dw_lock);
 	s->dw_buffer = NULL;
 	s->dw_size = 0;
+	s->sibling = -1;
+	s->listen_id = id;
+	s->batch = 0;
 	return s;
 }
 
@@ -528,14 +741,15 @@ open_socket(struct socket_server *ss, struct request_open * request, struct sock
 		ns->type = SOCKET_TYPE_CONNECTED;
 		struct sockaddr * addr = ai_ptr->ai_addr;
 		void * sin_addr = (ai_ptr->ai_family == AF_INET) ? (void*)&((struct sockaddr_in *)addr)->sin_addr : (void*)&((struct sockaddr_in6 *)addr)->sin6_addr;
-		if (inet_ntop(ai_ptr->ai_family, sin_addr, ss->buffer, sizeof(ss->buffer))) {
-			result->data = ss->buffer;
+		struct socket_shard *sd = socket_shard(ss, id);
+		if (inet_ntop(ai_ptr->ai_family, sin_addr, sd->buffer, sizeof(sd->buffer))) {
+			result->data = sd->buffer;
 		}
 		freeaddrinfo( ai_list );
 		return SOCKET_OPEN;
 	} else {
 		ns->type = SOCKET_TYPE_CONNECTING;
-		sp_write(ss->event_fd, ns->fd, ns, true);
+		sp_write(socket_shard(ss, id)->event_fd, ns->fd, ns, true);
 	}
 
 	freeaddrinfo( ai_list );
@@ -547,35 +761,65 @@ _failed:
 }
 
 static int
-send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_lock *l, struct socket_message *result) {
+gather_list(struct wb_list *list, struct iovec *iov, int n, size_t *sz) {
+	struct write_buffer *wb;
+	for (wb = list->head; wb && n < MAX_IOV; wb = wb->next) {
+		iov[n].iov_base = wb->ptr;
+		iov[n].iov_len = wb->sz;
+		*sz += wb->sz;
+		++n;
+	}
+	return n;
+}
+
+// free the buffers written, and return the bytes left for the next list
+static size_t
+consume_list(struct socket_server *ss, struct wb_list *list, size_t sz) {
 	while (list->head) {
 		struct write_buffer * tmp = list->head;
-		for (;;) {
-			ssize_t sz = write(s->fd, tmp->ptr, tmp->sz);
-			if (sz < 0) {
-				switch(errno) {
-				case EINTR:
-					continue;
-				case AGAIN_WOULDBLOCK:
-					return -1;
-				}
-				force_close(ss,s,l,result);
-				return SOCKET_CLOSE;
-			}
-			s->wb_size -= sz;
-			if (sz != tmp->sz) {
-				tmp->ptr += sz;
-				tmp->sz -= sz;
-				return -1;
-			}
-			break;
+		if (sz < (size_t)tmp->sz) {
+			// written a part
+			tmp->ptr += sz;
+			tmp->sz -= sz;
+			return 0;
 		}
+		sz -= tmp->sz;
 		list->head = tmp->next;
 		write_buffer_free(ss,tmp);
 	}
 	list->tail = NULL;
+	return sz;
+}
 
-	return -1;
+// Write the buffers of high list and then low list with writev, MAX_IOV buffers at once.
+static int
+send_list_tcp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
+	for (;;) {
+		struct iovec iov[MAX_IOV];
+		size_t total = 0;
+		int n = gather_list(&s->high, iov, 0, &total);
+		n = gather_list(&s->low, iov, n, &total);
+		if (n == 0)
+			return -1;
+		ssize_t sz = writev(s->fd, iov, n);
+		if (sz < 0) {
+			switch(errno) {
+			case EINTR:
+				continue;
+			case AGAIN_WOULDBLOCK:
+				return -1;
+			}
+			force_close(ss,s,l,result);
+			return SOCKET_CLOSE;
+		}
+		s->wb_size -= sz;
+		size_t left = consume_list(ss, &s->high, sz);
+		consume_list(ss, &s->low, left);
+		if ((size_t)sz != total) {
+			// the kernel buffer is full
+			return -1;
+		}
+	}
 }
 
 static socklen_t
@@ -637,15 +881,6 @@ send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 	return -1;
 }
 
-static int
-send_list(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_lock *l, struct socket_message *result) {
-	if (s->protocol == PROTOCOL_TCP) {
-		return send_list_tcp(ss, s, list, l, result);
-	} else {
-		return send_list_udp(ss, s, list, result);
-	}
-}
-
 static inline int
 list_uncomplete(struct wb_list *s) {
 	struct write_buffer *wb = s->head;
@@ -684,44 +919,49 @@ send_buffer_empty(struct socket *s) {
 	2. If high list is empty, try to send low list.
 	3. If low list head is uncomplete (send a part before), move the head of low list to empty high list (call raise_uncomplete) .
 	4. If two lists are both empty, turn off the event. (call check_close)
+
+	For tcp, step 1 and 2 are one writev of the high list followed by the low list.
  */
 static int
 send_buffer_(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
 	assert(!list_uncomplete(&s->low));
-	// step 1
-	if (send_list(ss,s,&s->high,l,result) == SOCKET_CLOSE) {
-		return SOCKET_CLOSE;
-	}
-	if (s->high.head == NULL) {
-		// step 2
-		if (s->low.head != NULL) {
-			if (send_list(ss,s,&s->low,l,result) == SOCKET_CLOSE) {
-				return SOCKET_CLOSE;
-			}
-			// step 3
-			if (list_uncomplete(&s->low)) {
-				raise_uncomplete(s);
-				return -1;
-			}
-			if (s->low.head)
-				return -1;
-		} 
-		// step 4
-		assert(send_buffer_empty(s) && s->wb_size == 0);
-		sp_write(ss->event_fd, s->fd, s, false);			
-
-		if (s->type == SOCKET_TYPE_HALFCLOSE) {
-				force_close(ss, s, l, result);
-				return SOCKET_CLOSE;
+	if (s->protocol == PROTOCOL_TCP) {
+		// step 1 and 2
+		if (send_list_tcp(ss,s,l,result) == SOCKET_CLOSE) {
+			return SOCKET_CLOSE;
 		}
-		if(s->warn_size > 0){
-				s->warn_size = 0;
-				result->opaque = s->opaque;
-				result->id = s->id;
-				result->ud = 0;
-				result->data = NULL;
-				return SOCKET_WARNING;
+		// step 3
+		if (s->high.head == NULL && list_uncomplete(&s->low)) {
+			raise_uncomplete(s);
+			return -1;
 		}
+		if (!send_buffer_empty(s))
+			return -1;
+	} else {
+		// step 1
+		send_list_udp(ss,s,&s->high,result);
+		if (s->high.head != NULL)
+			return -1;
+		// step 2
+		send_list_udp(ss,s,&s->low,result);
+		if (s->low.head != NULL)
+			return -1;
+	}
+	// step 4
+	assert(send_buffer_empty(s) && s->wb_size == 0);
+	sp_write(socket_shard(ss, s->id)->event_fd, s->fd, s, false);
+
+	if (s->type == SOCKET_TYPE_HALFCLOSE) {
+			force_close(ss, s, l, result);
+			return SOCKET_CLOSE;
+	}
+	if(s->warn_size > 0){
+			s->warn_size = 0;
+			result->opaque = s->opaque;
+			result->id = s->id;
+			result->ud = 0;
+			result->data = NULL;
+			return SOCKET_WARNING;
 	}
 
 	return -1;
@@ -838,7 +1078,7 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 				return -1;
 			}
 		}
-		sp_write(ss->event_fd, s->fd, s, true);
+		sp_write(socket_shard(ss, id)->event_fd, s->fd, s, true);
 	} else {
 		if (s->protocol == PROTOCOL_TCP) {
 			if (priority == PRIORITY_LOW) {
@@ -873,6 +1113,8 @@ listen_socket(struct socket_server *ss, struct request_listen * request, struct
 		goto _failed;
 	}
 	s->type = SOCKET_TYPE_PLISTEN;
+	s->sibling = request->sibling;
+	s->listen_id = request->listen_id;
 	return -1;
 _failed:
 	close(listen_fd);
@@ -890,6 +1132,20 @@ nomore_sending_data(struct socket *s) {
 	return send_buffer_empty(s) && s->dw_buffer == NULL && (s->sending & 0xffff) == 0;
 }
 
+static void send_request(struct socket_server *ss, int id, struct request_package *request, char type, int len);
+
+// forward the request of a listen socket to its sibling in the next shard
+static void
+forward_sibling(struct socket_server *ss, struct socket *s, char type, const void *request, int len) {
+	if (s->sibling < 0)
+		return;
+	struct request_package req;
+	memcpy(req.u.buffer, request, len);
+	// request_start and request_close both begin with id
+	*(int *)req.u.buffer = s->sibling;
+	send_request(ss, s->sibling, &req, type, len);
+}
+
 static int
 close_socket(struct socket_server *ss, struct request_close *request, struct socket_message *result) {
 	int id = request->id;
@@ -903,6 +1159,14 @@ close_socket(struct socket_server *ss, struct request_close *request, struct soc
 	}
 	struct socket_lock l;
 	socket_lock_init(s, &l);
+	if (s->listen_id != id) {
+		// a sibling listen socket is closed with the listen socket silently
+		forward_sibling(ss, s, 'K', request, sizeof(*request));
+		force_close(ss,s,&l,result);
+		clear_closed_event(socket_shard(ss, id), result, SOCKET_CLOSE);
+		return -1;
+	}
+	forward_sibling(ss, s, 'K', request, sizeof(*request));
 	if (!nomore_sending_data(s)) {
 		int type = send_buffer(ss,s,&l,result);
 		// type : -1 or SOCKET_WARNING or SOCKET_CLOSE, SOCKET_WARNING means nomore_sending_data
@@ -937,6 +1201,15 @@ bind_socket(struct socket_server *ss, struct request_bind *request, struct socke
 	return SOCKET_OPEN;
 }
 
+// The new owner may not know the batch messages, it sets it again if it wants.
+static inline void
+transfer_socket(struct socket *s, uintptr_t opaque) {
+	if (s->opaque != opaque) {
+		s->opaque = opaque;
+		s->batch = 0;
+	}
+}
+
 static int
 start_socket(struct socket_server *ss, struct request_start *request, struct socket_message *result) {
 	int id = request->id;
@@ -952,18 +1225,27 @@ start_socket(struct socket_server *ss, struct request_start *request, struct soc
 	struct socket_lock l;
 	socket_lock_init(s, &l);
 	if (s->type == SOCKET_TYPE_PACCEPT || s->type == SOCKET_TYPE_PLISTEN) {
-		if (sp_add(ss->event_fd, s->fd, s)) {
+		forward_sibling(ss, s, 'S', request, sizeof(*request));
+		if (sp_add(socket_shard(ss, id)->event_fd, s->fd, s)) {
+			if (s->listen_id != id) {
+				fprintf(stderr, "socket-server: start listen socket %d (sibling of %d) failed %s.\n", id, s->listen_id, strerror(errno));
+				force_close(ss, s, &l, result);
+				return -1;
+			}
 			force_close(ss, s, &l, result);
 			result->data = strerror(errno);
 			return SOCKET_ERR;
 		}
 		s->type = (s->type == SOCKET_TYPE_PACCEPT) ? SOCKET_TYPE_CONNECTED : SOCKET_TYPE_LISTEN;
-		s->opaque = request->opaque;
+		transfer_socket(s, request->opaque);
+		if (s->listen_id != id) {
+			return -1;
+		}
 		result->data = "start";
 		return SOCKET_OPEN;
 	} else if (s->type == SOCKET_TYPE_CONNECTED) {
 		// todo: maybe we should send a message SOCKET_TRANSFER to s->opaque
-		s->opaque = request->opaque;
+		transfer_socket(s, request->opaque);
 		result->data = "transfer";
 		return SOCKET_OPEN;
 	}
@@ -982,6 +1264,16 @@ setopt_socket(struct socket_server *ss, struct request_setopt *request) {
 	setsockopt(s->fd, IPPROTO_TCP, request->what, &v, sizeof(v));
 }
 
+static void
+setbatch_socket(struct socket_server *ss, struct request_setopt *request) {
+	int id = request->id;
+	struct socket *s = &ss->slot[HASH_ID(id)];
+	if (s->type == SOCKET_TYPE_INVALID || s->id !=id) {
+		return;
+	}
+	s->batch = request->value ? 1 : 0;
+}
+
 static void
 block_readpipe(int pipefd, void *buffer, int sz) {
 	for (;;) {
@@ -999,13 +1291,13 @@ block_readpipe(int pipefd, void *buffer, int sz) {
 }
 
 static int
-has_cmd(struct socket_server *ss) {
+has_cmd(struct socket_shard *sd) {
 	struct timeval tv = {0,0};
 	int retval;
 
-	FD_SET(ss->recvctrl_fd, &ss->rfds);
+	FD_SET(sd->recvctrl_fd, &sd->rfds);
 
-	retval = select(ss->recvctrl_fd+1, &ss->rfds, NULL, NULL, &tv);
+	retval = select(sd->recvctrl_fd+1, &sd->rfds, NULL, NULL, &tv);
 	if (retval == 1) {
 		return 1;
 	}
@@ -1089,10 +1381,20 @@ dec_sending_ref(struct socket_server *ss, int id) {
 	}
 }
 
+static void
+trigger_write(struct socket_server *ss, struct request_send * request) {
+	int id = request->id;
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	if (s->type == SOCKET_TYPE_INVALID || s->id != id) {
+		return;
+	}
+	sp_write(socket_shard(ss, id)->event_fd, s->fd, s, true);
+}
+
 // return type
 static int
-ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
-	int fd = ss->recvctrl_fd;
+ctrl_cmd(struct socket_server *ss, struct socket_shard *sd, struct socket_message *result) {
+	int fd = sd->recvctrl_fd;
 	// the length of message is one byte, so 256+8 buffer size is enough.
 	uint8_t buffer[256];
 	uint8_t header[2];
@@ -1126,6 +1428,9 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 		dec_sending_ref(ss, request->id);
 		return ret;
 	}
+	case 'W':
+		trigger_write(ss, (struct request_send *)buffer);
+		return -1;
 	case 'A': {
 		struct request_send_udp * rsu = (struct request_send_udp *)buffer;
 		return send_socket(ss, &rsu->send, result, PRIORITY_HIGH, rsu->address);
@@ -1135,6 +1440,9 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 	case 'T':
 		setopt_socket(ss, (struct request_setopt *)buffer);
 		return -1;
+	case 'G':
+		setbatch_socket(ss, (struct request_setopt *)buffer);
+		return -1;
 	case 'U':
 		add_udp_socket(ss, (struct request_udp *)buffer);
 		return -1;
@@ -1149,11 +1457,12 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 // return -1 (ignore) when error
 static int
 forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
-	int sz = s->p.size;
-	char * buffer = MALLOC(sz);
+	// p.size is the size of the block, read into all the space of it
+	int sz = s->p.size - POOL_HEADER;
+	char * buffer = pool_alloc(sz);
 	int n = (int)read(s->fd, buffer, sz);
 	if (n<0) {
-		FREE(buffer);
+		socket_server_free_data(buffer, sz);
 		switch(errno) {
 		case EINTR:
 			break;
@@ -1169,20 +1478,20 @@ forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lo
 		return -1;
 	}
 	if (n==0) {
-		FREE(buffer);
+		socket_server_free_data(buffer, sz);
 		force_close(ss, s, l, result);
 		return SOCKET_CLOSE;
 	}
 
 	if (s->type == SOCKET_TYPE_HALFCLOSE) {
 		// discard recv data
-		FREE(buffer);
+		socket_server_free_data(buffer, sz);
 		return -1;
 	}
 
 	if (n == sz) {
 		s->p.size *= 2;
-	} else if (sz > MIN_READ_BUFFER && n*2 < sz) {
+	} else if (s->p.size > MIN_READ_BUFFER && n*2 < sz) {
 		s->p.size /= 2;
 	}
 
@@ -1215,7 +1524,8 @@ static int
 forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
 	union sockaddr_all sa;
 	socklen_t slen = sizeof(sa);
-	int n = recvfrom(s->fd, ss->udpbuffer,MAX_UDP_PACKAGE,0,&sa.s,&slen);
+	uint8_t * udpbuffer = socket_shard(ss, s->id)->udpbuffer;
+	int n = recvfrom(s->fd, udpbuffer,MAX_UDP_PACKAGE,0,&sa.s,&slen);
 	if (n<0) {
 		switch(errno) {
 		case EINTR:
@@ -1233,15 +1543,15 @@ forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lo
 	if (slen == sizeof(sa.v4)) {
 		if (s->protocol != PROTOCOL_UDP)
 			return -1;
-		data = MALLOC(n + 1 + 2 + 4);
+		data = pool_alloc(n + 1 + 2 + 4);
 		gen_udp_address(PROTOCOL_UDP, &sa, data + n);
 	} else {
 		if (s->protocol != PROTOCOL_UDPv6)
 			return -1;
-		data = MALLOC(n + 1 + 2 + 16);
+		data = pool_alloc(n + 1 + 2 + 16);
 		gen_udp_address(PROTOCOL_UDPv6, &sa, data + n);
 	}
-	memcpy(data, ss->udpbuffer, n);
+	memcpy(data, udpbuffer, n);
 
 	result->opaque = s->opaque;
 	result->id = s->id;
@@ -1268,15 +1578,16 @@ report_connect(struct socket_server *ss, struct socket *s, struct socket_lock *l
 		result->opaque = s->opaque;
 		result->id = s->id;
 		result->ud = 0;
+		struct socket_shard *sd = socket_shard(ss, s->id);
 		if (nomore_sending_data(s)) {
-			sp_write(ss->event_fd, s->fd, s, false);
+			sp_write(sd->event_fd, s->fd, s, false);
 		}
 		union sockaddr_all u;
 		socklen_t slen = sizeof(u);
 		if (getpeername(s->fd, &u.s, &slen) == 0) {
 			void * sin_addr = (u.s.sa_family == AF_INET) ? (void*)&u.v4.sin_addr : (void *)&u.v6.sin6_addr;
-			if (inet_ntop(u.s.sa_family, sin_addr, ss->buffer, sizeof(ss->buffer))) {
-				result->data = ss->buffer;
+			if (inet_ntop(u.s.sa_family, sin_addr, sd->buffer, sizeof(sd->buffer))) {
+				result->data = sd->buffer;
 				return SOCKET_OPEN;
 			}
 		}
@@ -1294,7 +1605,7 @@ report_accept(struct socket_server *ss, struct socket *s, struct socket_message
 	if (client_fd < 0) {
 		if (errno == EMFILE || errno == ENFILE) {
 			result->opaque = s->opaque;
-			result->id = s->id;
+			result->id = s->listen_id;
 			result->ud = 0;
 			result->data = strerror(errno);
 			return -1;
@@ -1316,7 +1627,7 @@ report_accept(struct socket_server *ss, struct socket *s, struct socket_message
 	}
 	ns->type = SOCKET_TYPE_PACCEPT;
 	result->opaque = s->opaque;
-	result->id = s->id;
+	result->id = s->listen_id;
 	result->ud = id;
 	result->data = NULL;
 
@@ -1324,63 +1635,59 @@ report_accept(struct socket_server *ss, struct socket *s, struct socket_message
 	int sin_port = ntohs((u.s.sa_family == AF_INET) ? u.v4.sin_port : u.v6.sin6_port);
 	char tmp[INET6_ADDRSTRLEN];
 	if (inet_ntop(u.s.sa_family, sin_addr, tmp, sizeof(tmp))) {
-		snprintf(ss->buffer, sizeof(ss->buffer), "%s:%d", tmp, sin_port);
-		result->data = ss->buffer;
+		struct socket_shard *sd = socket_shard(ss, s->id);
+		snprintf(sd->buffer, sizeof(sd->buffer), "%s:%d", tmp, sin_port);
+		result->data = sd->buffer;
 	}
 
 	return 1;
 }
 
-static inline void 
-clear_closed_event(struct socket_server *ss, struct socket_message * result, int type) {
-	if (type == SOCKET_CLOSE || type == SOCKET_ERR) {
-		int id = result->id;
-		int i;
-		for (i=ss->event_index; i<ss->event_n; i++) {
-			struct event *e = &ss->ev[i];
-			struct socket *s = e->s;
-			if (s) {
-				if (s->type == SOCKET_TYPE_INVALID && s->id == id) {
-					e->s = NULL;
-					break;
-				}
-			}
-		}
-	}
-}
-
 // return type
 int 
 socket_server_poll(struct socket_server *ss, struct socket_message * result, int * more) {
+	return socket_server_poll_shard(ss, 0, result, more);
+}
+
+int
+socket_server_poll_shard(struct socket_server *ss, int shard, struct socket_message * result, int * more) {
+	struct socket_shard *sd = &ss->shard[shard];
 	for (;;) {
-		if (ss->checkctrl) {
-			if (has_cmd(ss)) {
-				int type = ctrl_cmd(ss, result);
+		if (sd->checkctrl) {
+			if (has_cmd(sd)) {
+				int type = ctrl_cmd(ss, sd, result);
 				if (type != -1) {
-					clear_closed_event(ss, result, type);
+					clear_closed_event(sd, result, type);
 					return type;
 				} else
 					continue;
 			} else {
-				ss->checkctrl = 0;
+				sd->checkctrl = 0;
 			}
 		}
-		if (ss->event_index == ss->event_n) {
-			ss->event_n = sp_wait(ss->event_fd, ss->ev, MAX_EVENT);
-			ss->checkctrl = 1;
+		if (sd->event_index == sd->event_n) {
+			if (more && !sd->idle) {
+				// All the events are processed, tell the caller before blocking in sp_wait
+				sd->idle = 1;
+				*more = 0;
+				return -1;
+			}
+			sd->idle = 0;
+			sd->event_n = sp_wait(sd->event_fd, sd->ev, MAX_EVENT);
+			sd->checkctrl = 1;
 			if (more) {
 				*more = 0;
 			}
-			ss->event_index = 0;
-			if (ss->event_n <= 0) {
-				ss->event_n = 0;
+			sd->event_index = 0;
+			if (sd->event_n <= 0) {
+				sd->event_n = 0;
 				if (errno == EINTR) {
 					continue;
 				}
 				return -1;
 			}
 		}
-		struct event *e = &ss->ev[ss->event_index++];
+		struct event *e = &sd->ev[sd->event_index++];
 		struct socket *s = e->s;
 		if (s == NULL) {
 			// dispatch pipe message at beginning
@@ -1413,14 +1720,14 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 					type = forward_message_udp(ss, s, &l, result);
 					if (type == SOCKET_UDP) {
 						// try read again
-						--ss->event_index;
+						--sd->event_index;
 						return SOCKET_UDP;
 					}
 				}
 				if (e->write && type != SOCKET_CLOSE && type != SOCKET_ERR) {
 					// Try to dispatch write message next step if write flag set.
 					e->read = false;
-					--ss->event_index;
+					--sd->event_index;
 				}
 				if (type == -1)
 					break;				
@@ -1454,12 +1761,14 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 	}
 }
 
+// send the request to the shard of the socket id
 static void
-send_request(struct socket_server *ss, struct request_package *request, char type, int len) {
+send_request(struct socket_server *ss, int id, struct request_package *request, char type, int len) {
 	request->header[6] = (uint8_t)type;
 	request->header[7] = (uint8_t)len;
+	int fd = socket_shard(ss, id)->sendctrl_fd;
 	for (;;) {
-		ssize_t n = write(ss->sendctrl_fd, &request->header[6], len+2);
+		ssize_t n = write(fd, &request->header[6], len+2);
 		if (n<0) {
 			if (errno != EINTR) {
 				fprintf(stderr, "socket-server : send ctrl command error %s.\n", strerror(errno));
@@ -1496,7 +1805,7 @@ socket_server_connect(struct socket_server *ss, uintptr_t opaque, const char * a
 	int len = open_request(ss, &request, opaque, addr, port);
 	if (len < 0)
 		return -1;
-	send_request(ss, &request, 'O', sizeof(request.u.open) + len);
+	send_request(ss, request.u.open.id, &request, 'O', sizeof(request.u.open) + len);
 	return request.u.open.id;
 }
 
@@ -1553,9 +1862,15 @@ socket_server_send(struct socket_server *ss, int id, const void * buffer, int sz
 			s->dw_size = sz;
 			s->dw_offset = n;
 
-			sp_write(ss->event_fd, s->fd, s, true);
-
 			socket_unlock(&l);
+
+			// The event pool is touched only by the socket thread of the shard (io_uring is not thread safe),
+			// let it enable the write event.
+			struct request_package request;
+			request.u.send.id = id;
+			request.u.send.sz = 0;
+			request.u.send.buffer = NULL;
+			send_request(ss, id, &request, 'W', sizeof(request.u.send));
 			return 0;
 		}
 		socket_unlock(&l);
@@ -1568,7 +1883,7 @@ socket_server_send(struct socket_server *ss, int id, const void * buffer, int sz
 	request.u.send.sz = sz;
 	request.u.send.buffer = (char *)buffer;
 
-	send_request(ss, &request, 'D', sizeof(request.u.send));
+	send_request(ss, id, &request, 'D', sizeof(request.u.send));
 	return 0;
 }
 
@@ -1588,14 +1903,18 @@ socket_server_send_lowpriority(struct socket_server *ss, int id, const void * bu
 	request.u.send.sz = sz;
 	request.u.send.buffer = (char *)buffer;
 
-	send_request(ss, &request, 'P', sizeof(request.u.send));
+	send_request(ss, id, &request, 'P', sizeof(request.u.send));
 	return 0;
 }
 
 void
 socket_server_exit(struct socket_server *ss) {
 	struct request_package request;
-	send_request(ss, &request, 'X', 0);
+	int i;
+	for (i=0;i<ss->shard_n;i++) {
+		// id i is in shard i
+		send_request(ss, i, &request, 'X', 0);
+	}
 }
 
 void
@@ -1604,7 +1923,7 @@ socket_server_close(struct socket_server *ss, uintptr_t opaque, int id) {
 	request.u.close.id = id;
 	request.u.close.shutdown = 0;
 	request.u.close.opaque = opaque;
-	send_request(ss, &request, 'K', sizeof(request.u.close));
+	send_request(ss, id, &request, 'K', sizeof(request.u.close));
 }
 
 
@@ -1614,13 +1933,13 @@ socket_server_shutdown(struct socket_server *ss, uintptr_t opaque, int id) {
 	request.u.close.id = id;
 	request.u.close.shutdown = 1;
 	request.u.close.opaque = opaque;
-	send_request(ss, &request, 'K', sizeof(request.u.close));
+	send_request(ss, id, &request, 'K', sizeof(request.u.close));
 }
 
 // return -1 means failed
 // or return AF_INET or AF_INET6
 static int
-do_bind(const char *host, int port, int protocol, int *family) {
+do_bind(const char *host, int port, int protocol, int *family, int reuseport) {
 	int fd;
 	int status;
 	int reuse = 1;
@@ -1653,6 +1972,11 @@ do_bind(const char *host, int port, int protocol, int *family) {
 	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&reuse, sizeof(int))==-1) {
 		goto _failed;
 	}
+#ifdef SO_REUSEPORT
+	if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *)&reuse, sizeof(int))==-1) {
+		goto _failed;
+	}
+#endif
 	status = bind(fd, (struct sockaddr *)ai_list->ai_addr, ai_list->ai_addrlen);
 	if (status != 0)
 		goto _failed;
@@ -1667,9 +1991,9 @@ _failed_fd:
 }
 
 static int
-do_listen(const char * host, int port, int backlog) {
+do_listen(const char * host, int port, int backlog, int reuseport) {
 	int family = 0;
-	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family);
+	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family, reuseport);
 	if (listen_fd < 0) {
 		return -1;
 	}
@@ -1680,9 +2004,50 @@ do_listen(const char * host, int port, int backlog) {
 	return listen_fd;
 }
 
+// One listen socket (SO_REUSEPORT) in each shard, the kernel spreads the connections among them.
+// The first one is the listen socket the caller knows, the others are its siblings and report the accept with its id.
+static int
+listen_reuseport(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
+	int n = ss->shard_n;
+	int fd[n];
+	int id[n];
+	int i;
+	for (i=0;i<n;i++) {
+		fd[i] = do_listen(addr, port, backlog, 1);
+		if (fd[i] < 0) {
+			goto _failed;
+		}
+		id[i] = (i == 0) ? reserve_id(ss) : reserve_id_shard(ss, (shard_index(ss, id[0]) + i) % n);
+		if (id[i] < 0) {
+			close(fd[i]);
+			goto _failed;
+		}
+	}
+	// the siblings first, so they are ready when the listen socket starts them
+	for (i=n-1;i>=0;i--) {
+		struct request_package request;
+		request.u.listen.opaque = opaque;
+		request.u.listen.id = id[i];
+		request.u.listen.fd = fd[i];
+		request.u.listen.sibling = (i == n-1) ? -1 : id[i+1];
+		request.u.listen.listen_id = id[0];
+		send_request(ss, id[i], &request, 'L', sizeof(request.u.listen));
+	}
+	return id[0];
+_failed:
+	while (--i >= 0) {
+		close(fd[i]);
+		ss->slot[HASH_ID(id[i])].type = SOCKET_TYPE_INVALID;
+	}
+	return -1;
+}
+
 int 
 socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
-	int fd = do_listen(addr, port, backlog);
+	if (ss->reuseport && ss->shard_n > 1 && port != 0) {
+		return listen_reuseport(ss, opaque, addr, port, backlog);
+	}
+	int fd = do_listen(addr, port, backlog, 0);
 	if (fd < 0) {
 		return -1;
 	}
@@ -1695,7 +2060,9 @@ socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * ad
 	request.u.listen.opaque = opaque;
 	request.u.listen.id = id;
 	request.u.listen.fd = fd;
-	send_request(ss, &request, 'L', sizeof(request.u.listen));
+	request.u.listen.sibling = -1;
+	request.u.listen.listen_id = id;
+	send_request(ss, id, &request, 'L', sizeof(request.u.listen));
 	return id;
 }
 
@@ -1708,7 +2075,7 @@ socket_server_bind(struct socket_server *ss, uintptr_t opaque, int fd) {
 	request.u.bind.opaque = opaque;
 	request.u.bind.id = id;
 	request.u.bind.fd = fd;
-	send_request(ss, &request, 'B', sizeof(request.u.bind));
+	send_request(ss, id, &request, 'B', sizeof(request.u.bind));
 	return id;
 }
 
@@ -1717,7 +2084,7 @@ socket_server_start(struct socket_server *ss, uintptr_t opaque, int id) {
 	struct request_package request;
 	request.u.start.id = id;
 	request.u.start.opaque = opaque;
-	send_request(ss, &request, 'S', sizeof(request.u.start));
+	send_request(ss, id, &request, 'S', sizeof(request.u.start));
 }
 
 void
@@ -1726,7 +2093,23 @@ socket_server_nodelay(struct socket_server *ss, int id) {
 	request.u.setopt.id = id;
 	request.u.setopt.what = TCP_NODELAY;
 	request.u.setopt.value = 1;
-	send_request(ss, &request, 'T', sizeof(request.u.setopt));
+	send_request(ss, id, &request, 'T', sizeof(request.u.setopt));
+}
+
+void
+socket_server_batch(struct socket_server *ss, int id, int enable) {
+	struct request_package request;
+	request.u.setopt.id = id;
+	request.u.setopt.what = 0;
+	request.u.setopt.value = enable;
+	send_request(ss, id, &request, 'G', sizeof(request.u.setopt));
+}
+
+// Only call it in the socket thread of the shard, after the SOCKET_DATA of id is polled.
+int
+socket_server_isbatch(struct socket_server *ss, int id) {
+	struct socket *s = &ss->slot[HASH_ID(id)];
+	return s->id == id && s->batch;
 }
 
 void 
@@ -1742,7 +2125,7 @@ socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr,
 	int family;
 	if (port != 0 || addr != NULL) {
 		// bind
-		fd = do_bind(addr, port, IPPROTO_UDP, &family);
+		fd = do_bind(addr, port, IPPROTO_UDP, &family, 0);
 		if (fd < 0) {
 			return -1;
 		}
@@ -1766,7 +2149,7 @@ socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr,
 	request.u.udp.opaque = opaque;
 	request.u.udp.family = family;
 
-	send_request(ss, &request, 'U', sizeof(request.u.udp));	
+	send_request(ss, id, &request, 'U', sizeof(request.u.udp));
 	return id;
 }
 
@@ -1822,7 +2205,7 @@ socket_server_udp_send(struct socket_server *ss, int id, const struct socket_udp
 
 	memcpy(request.u.send_udp.address, udp_address, addrsz);
 
-	send_request(ss, &request, 'A', sizeof(request.u.send_udp.send)+addrsz);
+	send_request(ss, id, &request, 'A', sizeof(request.u.send_udp.send)+addrsz);
 	return 0;
 }
 
@@ -1873,7 +2256,7 @@ socket_server_udp_connect(struct socket_server *ss, int id, const char * addr, i
 
 	freeaddrinfo( ai_list );
 
-	send_request(ss, &request, 'C', sizeof(request.u.set_udp) - sizeof(request.u.set_udp.address) +addrsz);
+	send_request(ss, id, &request, 'C', sizeof(request.u.set_udp) - sizeof(request.u.set_udp.address) +addrsz);
 
 	return 0;
 }
@@ -22,8 +22,15 @@ struct socket_message {
 };
 
 struct socket_server * socket_server_create();
+// n shards, each one has its own event pool and ctrl pipe, and should be polled by its own thread with socket_server_poll_shard.
+// The listen sockets have one sibling in each shard (SO_REUSEPORT) if reuseport is set.
+struct socket_server * socket_server_create_shards(int n, int reuseport);
 void socket_server_release(struct socket_server *);
+// poll the shard 0
+// If more is not NULL, *more is set to 0 when all the events of the last wait are processed,
+// and it returns -1 once before blocking in the next wait.
 int socket_server_poll(struct socket_server *, struct socket_message *result, int *more);
+int socket_server_poll_shard(struct socket_server *, int shard, struct socket_message *result, int *more);
 
 void socket_server_exit(struct socket_server *);
 void socket_server_close(struct socket_server *, uintptr_t opaque, int id);
@@ -41,6 +48,9 @@ int socket_server_bind(struct socket_server *, uintptr_t opaque, int fd);
 
 // for tcp
 void socket_server_nodelay(struct socket_server *, int id);
+// The caller may batch the SOCKET_DATA of the socket when it's enabled. (See skynet_socket_batch)
+void socket_server_batch(struct socket_server *, int id, int enable);
+int socket_server_isbatch(struct socket_server *, int id);
 
 struct socket_udp_address;
 
@@ -64,4 +74,17 @@ struct socket_object_interface {
 // if you send package sz == -1, use soi.
 void socket_server_userobject(struct socket_server *, struct socket_object_interface *soi);
 
+// The data of SOCKET_DATA and SOCKET_UDP comes from a pool of receive buffers, return it here (never by skynet_free).
+// The buffer keeps its size class, sz (ud) is not used.
+void socket_server_free_data(void *data, int sz);
+
+struct socket_buffer_stat {
+	uint64_t alloc;	// the buffers allocated by malloc
+	uint64_t reuse;	// the buffers reused from the pool
+	uint64_t release;	// the buffers returned to the pool
+	uint64_t cached;	// bytes in the pool
+};
+
+void socket_server_buffer_stat(struct socket_buffer_stat *);
+
 #endif
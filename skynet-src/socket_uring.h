@@ -0,0 +1,361 @@
+#ifndef poll_socket_uring_h
+#define poll_socket_uring_h
+
+/*
+	An io_uring backend of socket_poll.h (linux 5.1+), build with -DUSE_IO_URING.
+
+	Each socket has one oneshot IORING_OP_POLL_ADD in flight, it's armed again after the event is reported,
+	so the semantics is the same as level triggered epoll.
+	sp_add/sp_write only queue the socket, the polls are armed and submitted with the wait in one io_uring_enter,
+	instead of one epoll_ctl per change. They are armed only in sp_wait, so an event is never older than the wait.
+	sp_del submits the poll remove at once, because the socket will be closed after it.
+ */
+
+#include <netdb.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+
+#include "skynet_malloc.h"
+
+#define URING_ENTRIES 1024
+#define URING_REMOVE 0	// user_data of POLL_REMOVE, the completion is ignored
+
+struct uring_slot {
+	void * ud;
+	uint64_t armed;	// user_data of the poll in flight, 0 for none
+	uint32_t gen;
+	uint32_t events;
+	bool used;
+	bool queued;	// in the arm queue
+};
+
+struct uring_poll {
+	int ring_fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void * sq_ptr;
+	void * cq_ptr;
+	size_t sq_sz;
+	size_t cq_sz;
+	size_t sqe_sz;
+	int slot_n;
+	struct uring_slot * slot;	// index by fd
+	int queue_n;
+	int queue_cap;
+	int * queue;	// the fd to arm in next sp_wait
+};
+
+static bool
+sp_invalid(struct uring_poll *u) {
+	return u == NULL;
+}
+
+// queued but not submitted
+static inline unsigned
+uring_pending(struct uring_poll *u) {
+	return *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static int
+uring_enter(struct uring_poll *u, unsigned min_complete) {
+	unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+	return (int)syscall(__NR_io_uring_enter, u->ring_fd, uring_pending(u), min_complete, flags, NULL, 0);
+}
+
+static void
+uring_submit(struct uring_poll *u) {
+	while (uring_pending(u) > 0) {
+		int r = uring_enter(u, 0);
+		if (r == 0 || (r < 0 && errno != EINTR)) {
+			// EAGAIN/EBUSY : the completion queue is full, retry in sp_wait
+			return;
+		}
+	}
+}
+
+static struct io_uring_sqe *
+uring_sqe(struct uring_poll *u) {
+	unsigned tail = *u->sq_tail;
+	if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) > *u->sq_mask) {
+		uring_submit(u);
+		if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) > *u->sq_mask) {
+			return NULL;
+		}
+	}
+	unsigned index = tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	u->sq_array[index] = index;
+	return sqe;
+}
+
+static void
+uring_push(struct uring_poll *u) {
+	__atomic_store_n(u->sq_tail, *u->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+static void
+uring_queue(struct uring_poll *u, int sock) {
+	struct uring_slot *slot = &u->slot[sock];
+	if (slot->queued) {
+		return;
+	}
+	if (u->queue_n >= u->queue_cap) {
+		u->queue_cap = u->queue_cap ? u->queue_cap * 2 : 64;
+		u->queue = skynet_realloc(u->queue, u->queue_cap * sizeof(int));
+	}
+	u->queue[u->queue_n++] = sock;
+	slot->queued = true;
+}
+
+static void
+uring_arm(struct uring_poll *u, int sock) {
+	struct uring_slot *slot = &u->slot[sock];
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	if (sqe == NULL) {
+		// try again in next sp_wait
+		uring_queue(u, sock);
+		return;
+	}
+	if (++slot->gen == 0) {
+		slot->gen = 1;
+	}
+	slot->armed = (uint64_t)slot->gen << 32 | (uint32_t)sock;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = sock;
+	sqe->poll32_events = slot->events;
+	sqe->user_data = slot->armed;
+	uring_push(u);
+}
+
+static void
+uring_disarm(struct uring_poll *u, int sock) {
+	struct uring_slot *slot = &u->slot[sock];
+	if (slot->armed == 0) {
+		return;
+	}
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	if (sqe) {
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = slot->armed;
+		sqe->user_data = URING_REMOVE;
+		uring_push(u);
+	}
+	// the completion of the removed poll is stale
+	slot->armed = 0;
+}
+
+static struct uring_poll *
+sp_create() {
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct uring_poll *u = skynet_malloc(sizeof(*u));
+	memset(u, 0, sizeof(*u));
+	u->ring_fd = fd;
+	u->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_sz > u->sq_sz)
+			u->sq_sz = u->cq_sz;
+		u->cq_sz = u->sq_sz;
+	}
+	u->sq_ptr = mmap(NULL, u->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (u->sq_ptr == MAP_FAILED) {
+		goto _failed;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_ptr = u->sq_ptr;
+	} else {
+		u->cq_ptr = mmap(NULL, u->cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (u->cq_ptr == MAP_FAILED) {
+			munmap(u->sq_ptr, u->sq_sz);
+			goto _failed;
+		}
+	}
+	u->sqe_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqe_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		if (u->cq_ptr != u->sq_ptr)
+			munmap(u->cq_ptr, u->cq_sz);
+		munmap(u->sq_ptr, u->sq_sz);
+		goto _failed;
+	}
+	char *sq = u->sq_ptr;
+	u->sq_head = (unsigned *)(sq + p.sq_off.head);
+	u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)(sq + p.sq_off.array);
+	char *cq = u->cq_ptr;
+	u->cq_head = (unsigned *)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return u;
+_failed:
+	close(fd);
+	skynet_free(u);
+	return NULL;
+}
+
+static void
+sp_release(struct uring_poll *u) {
+	munmap(u->sqes, u->sqe_sz);
+	if (u->cq_ptr != u->sq_ptr)
+		munmap(u->cq_ptr, u->cq_sz);
+	munmap(u->sq_ptr, u->sq_sz);
+	close(u->ring_fd);
+	skynet_free(u->slot);
+	skynet_free(u->queue);
+	skynet_free(u);
+}
+
+static int
+sp_add(struct uring_poll *u, int sock, void *ud) {
+	if (sock < 0) {
+		return 1;
+	}
+	if (sock >= u->slot_n) {
+		int n = u->slot_n ? u->slot_n : 64;
+		while (n <= sock) {
+			n *= 2;
+		}
+		struct uring_slot * slot = skynet_realloc(u->slot, n * sizeof(*slot));
+		memset(slot + u->slot_n, 0, (n - u->slot_n) * sizeof(*slot));
+		u->slot = slot;
+		u->slot_n = n;
+	}
+	struct uring_slot *slot = &u->slot[sock];
+	// the old poll of the same fd, if it's closed without sp_del
+	uring_disarm(u, sock);
+	slot->used = true;
+	slot->ud = ud;
+	slot->events = POLLIN;
+	uring_queue(u, sock);
+	return 0;
+}
+
+static void
+sp_del(struct uring_poll *u, int sock) {
+	if (sock < 0 || sock >= u->slot_n || !u->slot[sock].used) {
+		return;
+	}
+	uring_disarm(u, sock);
+	u->slot[sock].used = false;
+	// The poll holds the file, remove it before the socket is closed
+	uring_submit(u);
+}
+
+static void
+sp_write(struct uring_poll *u, int sock, void *ud, bool enable) {
+	if (sock < 0 || sock >= u->slot_n || !u->slot[sock].used) {
+		return;
+	}
+	struct uring_slot *slot = &u->slot[sock];
+	uint32_t events = POLLIN | (enable ? POLLOUT : 0);
+	slot->ud = ud;
+	if (slot->events == events && (slot->armed || slot->queued)) {
+		return;
+	}
+	slot->events = events;
+	uring_disarm(u, sock);
+	uring_queue(u, sock);
+}
+
+static int
+sp_wait(struct uring_poll *u, struct event *e, int max) {
+	int n = 0;
+	while (n == 0) {
+		int i;
+		int queue_n = u->queue_n;
+		// uring_arm may queue it again (when the submission queue is full), at an index not after i
+		u->queue_n = 0;
+		for (i=0;i<queue_n;i++) {
+			int sock = u->queue[i];
+			struct uring_slot *slot = &u->slot[sock];
+			slot->queued = false;
+			if (slot->used && slot->armed == 0) {
+				uring_arm(u, sock);
+			}
+		}
+		unsigned head = *u->cq_head;
+		if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) || uring_pending(u)) {
+			// submit the queued polls, and wait for one completion at least if there is none
+			unsigned wait = head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) ? 1 : 0;
+			if (uring_enter(u, wait) < 0) {
+				if (errno != EAGAIN && errno != EBUSY)
+					return -1;
+			}
+		}
+		unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail && n < max) {
+			struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+			++head;
+			uint64_t data = cqe->user_data;
+			int res = cqe->res;
+			if (data == URING_REMOVE) {
+				continue;
+			}
+			int sock = (int)(uint32_t)data;
+			if (sock >= u->slot_n) {
+				continue;
+			}
+			struct uring_slot *slot = &u->slot[sock];
+			if (!slot->used || slot->armed != data) {
+				// stale (removed) poll
+				continue;
+			}
+			slot->armed = 0;
+			struct event *ev = &e[n++];
+			ev->s = slot->ud;
+			if (res < 0) {
+				ev->read = false;
+				ev->write = false;
+				ev->error = true;
+			} else {
+				unsigned flag = (unsigned)res;
+				ev->write = (flag & POLLOUT) != 0;
+				ev->read = (flag & (POLLIN | POLLHUP)) != 0;
+				ev->error = (flag & POLLERR) != 0;
+			}
+			// oneshot, arm it again in the next wait
+			uring_queue(u, sock);
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return n;
+}
+
+static void
+sp_nonblocking(int fd) {
+	int flag = fcntl(fd, F_GETFL, 0);
+	if ( -1 == flag ) {
+		return;
+	}
+
+	fcntl(fd, F_SETFL, flag | O_NONBLOCK);
+}
+
+#endif
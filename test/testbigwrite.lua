@@ -0,0 +1,70 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+-- A 16M socket.write to a reader in another service. The worker writes a part of it directly,
+-- and the socket thread sends the rest after the write event is enabled.
+-- Build with -DUSE_IO_URING to check the io_uring backend too.
+
+local mode = ...
+
+local PORT = 8010
+local SIZE = 16 * 1024 * 1024
+local BLOCK = "0123456789abcdef"
+
+if mode == "reader" then
+
+skynet.start(function()
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	local result
+	socket.start(listen_id, function(id)
+		socket.close(listen_id)
+		socket.start(id)
+		local bytes = 0
+		local broken = false
+		local rest = ""
+		while true do
+			local data = socket.read(id)
+			if not data then
+				break
+			end
+			bytes = bytes + #data
+			-- check the content block by block
+			data = rest .. data
+			local n = #data - #data % #BLOCK
+			for i = 1, n, #BLOCK do
+				if data:sub(i, i + #BLOCK - 1) ~= BLOCK then
+					broken = true
+					break
+				end
+			end
+			rest = data:sub(n + 1)
+		end
+		socket.close(id)
+		result = { bytes = bytes, broken = broken or rest ~= "" }
+	end)
+	skynet.dispatch("lua", function()
+		while not result do
+			skynet.sleep(1)
+		end
+		skynet.ret(skynet.pack(result.bytes, result.broken))
+		skynet.exit()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local reader = skynet.newservice(SERVICE_NAME, "reader")
+	local id = assert(socket.open("127.0.0.1", PORT))
+	local start = skynet.now()
+	socket.write(id, string.rep(BLOCK, SIZE // #BLOCK))
+	-- close after all the data is sent
+	socket.close(id)
+	local bytes, broken = skynet.call(reader, "lua")
+	local ti = skynet.now() - start
+	assert(bytes == SIZE and not broken, string.format("read %d bytes, broken %s", bytes, broken))
+	skynet.error(string.format("write %d bytes in %.2fs", SIZE, ti / 100))
+	skynet.exit()
+end)
+
+end
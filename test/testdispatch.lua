@@ -0,0 +1,85 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- A hot service with a deep queue and a latency sensitive service share the workers.
+-- Compare dispatch = "weight" and dispatch = "adaptive" (see examples/config) :
+-- the echo round trip shows the fairness, the hot service rate shows the throughput.
+
+local mode = ...
+
+if mode == "hot" then
+
+local count = 0
+
+skynet.start(function()
+	skynet.dispatch("lua", function(session)
+		if session == 0 then
+			-- about a few microseconds of work
+			local s = 0
+			for i = 1, 200 do
+				s = s + i
+			end
+			count = count + 1
+		else
+			skynet.ret(skynet.pack(count, skynet.stat "turn", skynet.stat "cost"))
+		end
+	end)
+end)
+
+elseif mode == "echo" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		skynet.ret()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local hot = skynet.newservice(SERVICE_NAME, "hot")
+	local echo = skynet.newservice(SERVICE_NAME, "echo")
+	local flooding = true
+	local sent = 0
+	skynet.fork(function()
+		while flooding do
+			for i = 1, 10000 do
+				skynet.send(hot, "lua")
+			end
+			sent = sent + 10000
+			skynet.sleep(1)
+		end
+	end)
+	local max, total = 0, 0
+	local N = 100
+	local start = skynet.now()
+	for i = 1, N do
+		local t = skynet.now()
+		skynet.call(echo, "lua")
+		t = skynet.now() - t
+		total = total + t
+		if t > max then
+			max = t
+		end
+		skynet.sleep(2)
+	end
+	flooding = false
+	local elapsed = skynet.now() - start
+	local count, turn, cost = skynet.call(hot, "lua")
+	-- the call is queued after all the messages sent before it
+	assert(count == sent, string.format("hot service gets %d of %d messages", count, sent))
+	local dispatch = skynet.getenv "dispatch"
+	if dispatch == "adaptive" then
+		-- the deep queue is dispatched in long turns
+		assert(count > turn * 2, string.format("%d messages in %d turns", count, turn))
+	end
+	skynet.error(string.format("dispatch = %s", dispatch))
+	skynet.error(string.format("echo : avg %.2fcs max %dcs", total / N, max))
+	skynet.error(string.format("hot : %d msg/s, %d turns, %.1f msg per turn, %.2fus per msg",
+		count * 100 // elapsed, turn, count / turn, cost))
+	skynet.kill(hot)
+	skynet.kill(echo)
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,79 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- skynet.getenv is lock-free, the env table grows (copy on write) while the readers are reading.
+
+local mode = ...
+
+local KEYS = 1000
+
+if mode == "writer" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, id)
+		for i = 1, KEYS do
+			skynet.setenv(string.format("testenv_%d_%d", id, i), tostring(i))
+			if i % 100 == 0 then
+				skynet.yield()
+			end
+		end
+		skynet.ret()
+	end)
+end)
+
+elseif mode == "reader" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, n)
+		local thread = skynet.getenv "thread"
+		for i = 1, n do
+			assert(skynet.getenv "thread" == thread)
+			local v = skynet.getenv(string.format("testenv_%d_%d", i % 4 + 1, i % KEYS + 1))
+			assert(v == nil or v == tostring(i % KEYS + 1))
+		end
+		skynet.ret()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local readers, writers = {}, {}
+	for i = 1, 4 do
+		readers[i] = skynet.newservice(SERVICE_NAME, "reader")
+		writers[i] = skynet.newservice(SERVICE_NAME, "writer")
+	end
+	local N = 100000
+	local start = skynet.now()
+	local done = 0
+	local co = coroutine.running()
+	local function finish()
+		done = done + 1
+		if done == 8 then
+			skynet.wakeup(co)
+		end
+	end
+	for i = 1, 4 do
+		skynet.fork(function()
+			skynet.call(writers[i], "lua", i)
+			finish()
+		end)
+		skynet.fork(function()
+			skynet.call(readers[i], "lua", N)
+			finish()
+		end)
+	end
+	skynet.wait()
+	local ti = skynet.now() - start
+	for i = 1, 4 do
+		for k = 1, KEYS do
+			assert(skynet.getenv(string.format("testenv_%d_%d", i, k)) == tostring(k))
+		end
+		skynet.kill(readers[i])
+		skynet.kill(writers[i])
+	end
+	skynet.error(string.format("%d getenv in %.2fs, while %d keys are set", N * 4 * 2, ti / 100, KEYS * 4))
+	skynet.exit()
+end)
+
+end
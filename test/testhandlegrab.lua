@@ -0,0 +1,80 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- The senders keep sending to a set of services, while the services are killed and created again,
+-- and the handle slot table grows. skynet_handle_grab is lock-free, the retired contexts must not be used after free.
+
+local mode = ...
+
+if mode == "target" then
+
+-- the senders may send to it before skynet.start
+skynet.dispatch("lua", function() end)
+
+skynet.start(function() end)
+
+elseif mode == "sender" then
+
+local running = true
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, from, to)
+		if cmd == "start" then
+			skynet.fork(function()
+				while running do
+					-- send to all the handles in the range, the target may be killed or not created yet
+					for addr = from, to do
+						pcall(skynet.send, addr, "lua")
+					end
+					skynet.yield()
+				end
+			end)
+			skynet.ret()
+		else
+			running = false
+			skynet.ret()
+		end
+	end)
+end)
+
+else
+
+local SENDER = 4
+local TARGET = 50
+local ROUND = 10
+
+skynet.start(function()
+	local senders = {}
+	for i = 1, SENDER do
+		senders[i] = skynet.newservice(SERVICE_NAME, "sender")
+	end
+	local targets = {}
+	for i = 1, TARGET do
+		targets[i] = skynet.newservice(SERVICE_NAME, "target")
+	end
+	-- the handles are allocated in order, the range covers the targets of all the rounds (and no other services)
+	local from = targets[1]
+	local to = from + TARGET * (ROUND + 1)
+	for i = 1, SENDER do
+		skynet.call(senders[i], "lua", "start", from, to)
+	end
+	local start = skynet.now()
+	for r = 1, ROUND do
+		for i = 1, TARGET do
+			skynet.kill(targets[i])
+			targets[i] = skynet.newservice(SERVICE_NAME, "target")
+		end
+	end
+	for i = 1, SENDER do
+		skynet.call(senders[i], "lua", "stop")
+		skynet.kill(senders[i])
+	end
+	for i = 1, TARGET do
+		skynet.kill(targets[i])
+	end
+	skynet.error(string.format("%d services created and killed in %.2fs, while %d senders are sending",
+		TARGET * ROUND, (skynet.now() - start) / 100, SENDER))
+	skynet.exit()
+end)
+
+end
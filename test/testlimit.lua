@@ -0,0 +1,103 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- A stalled service with a bounded queue, the flood can't grow its queue (and memory) beyond the limit.
+-- Each policy (reject, drop, signal) is tested in turn. With drop policy, the queue is trimmed to the limit when the service runs again.
+-- The socket data queued meanwhile is never dropped (tested with drop policy).
+
+local mode, policy = ...
+
+local LIMIT = 1000
+local PORT = 8008
+local LINE = string.rep("x", 99) .. "\n"
+
+if mode == "slow" then
+
+local socket = require "skynet.socket"
+
+local received = 0
+
+skynet.start(function()
+	skynet.limit(LIMIT, policy)
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id)
+		skynet.fork(function()
+			socket.start(id)
+			while socket.readline(id) do
+				received = received + 1
+			end
+		end)
+	end)
+	skynet.dispatch("lua", function(_,_, cmd, ti)
+		if cmd == "stall" then
+			local t = skynet.now()
+			while skynet.now() - t < ti do end
+		elseif cmd == "stat" then
+			skynet.ret(skynet.pack(skynet.stat "mqpeak", skynet.stat "dropped", received))
+		else
+			skynet.ret()
+		end
+	end)
+end)
+
+else
+
+local socket = require "skynet.socket"
+
+local function test(policy)
+	local slow = skynet.newservice(SERVICE_NAME, "slow", policy)
+	local id = assert(socket.open("127.0.0.1", PORT))
+	skynet.call(slow, "lua", "stat")	-- reset peak
+	skynet.backpressure()	-- reset
+	skynet.send(slow, "lua", "stall", 50)
+	local lines = policy == "drop" and LIMIT or 0
+	for i = 1, lines do
+		socket.write(id, LINE)
+	end
+	-- the stalled slow service can't pop the messages
+	local failed = 0
+	local function calls()
+		for i = 1, 10 do
+			skynet.fork(function()
+				if not pcall(skynet.call, slow, "lua", "blackhole") then
+					failed = failed + 1
+				end
+			end)
+		end
+		skynet.yield()
+	end
+	calls()	-- the oldest ones
+	local rejected = 0
+	for i = 1, LIMIT * 10 do
+		if not skynet.send(slow, "lua", "blackhole") then
+			rejected = rejected + 1
+		end
+	end
+	calls()	-- the newest ones
+	local backpressure = skynet.backpressure()
+	skynet.sleep(100)
+	local peak, dropped, received = skynet.call(slow, "lua", "stat")
+	skynet.error(string.format("%-6s : peak %d, rejected %d, dropped %d, failed calls %d, backpressure %d, received lines %d",
+		policy, peak, rejected, dropped, failed, backpressure, received))
+	assert(received == lines, "socket data is lost")
+	socket.close(id)
+	if policy == "reject" then
+		-- the newest calls fail fast
+		assert(peak <= LIMIT + 1 and rejected > 0 and failed == 10)
+	elseif policy == "drop" then
+		-- the oldest calls get an error, the newest ones may be rejected beyond twice the limit
+		assert(peak <= LIMIT * 2 + 1 and dropped > 0 and failed >= 10)
+	else
+		assert(rejected == 0 and failed == 0 and backpressure > 0)
+	end
+	skynet.kill(slow)
+end
+
+skynet.start(function()
+	test "reject"
+	test "drop"
+	test "signal"
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,42 @@
+local skynet = require "skynet"
+local core = require "skynet.core"
+require "skynet.manager"	-- import skynet.kill
+
+-- A message runs longer than monitor_threshold (default 1000ms), the monitor reports it with the lua traceback,
+-- and counts it for the service. See "long" in debug console.
+
+local mode = ...
+
+if mode == "busy" then
+
+local function busy_loop(ti)
+	local t = skynet.now()
+	while skynet.now() - t < ti do end
+end
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, ti)
+		busy_loop(ti)
+		skynet.ret()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local busy = skynet.newservice(SERVICE_NAME, "busy")
+	local addr = skynet.address(busy)
+	assert(core.command("LONG", addr) == "0")
+	skynet.call(busy, "lua", 10)
+	assert(core.command("LONG", addr) == "0")
+	local threshold = tonumber(skynet.getenv "monitor_threshold") or 1000
+	-- it's reported only once
+	skynet.call(busy, "lua", threshold // 10 * 2 + 50)
+	assert(core.command("LONG", addr) == "1")
+	skynet.error("The traceback of busy_loop should be in the log above")
+	skynet.kill(busy)
+	assert(core.command("LONG", addr) == nil)
+	skynet.exit()
+end)
+
+end
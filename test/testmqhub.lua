@@ -0,0 +1,97 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- Many producers send to one hub service, it shows how message queue push scales with producer threads.
+-- Run it with different thread config (8, 16, 32) to compare.
+--
+-- The median of 3 runs (thread = 4 on 1 cpu, msg/s), before and after the message nodes are cached:
+--   producer      1      2      4      8     16
+--   malloc     162k   166k   165k   193k   194k
+--   cached     185k   178k   186k   188k   216k
+-- The hub is bound by lua here. The push and pop alone (4 producer threads hand 1024 messages in turn
+-- to a consumer thread) cost 90-100ns per message with malloc and 55-63ns with the node cache.
+
+local mode = ...
+
+skynet.register_protocol {
+	name = "text",
+	id = skynet.PTYPE_TEXT,
+	pack = function(m) return tostring(m) end,
+	unpack = skynet.tostring,
+}
+
+if mode == "hub" then
+
+local count = 0
+local expect
+local start_time
+local done
+local last = {}	-- the last sequence number from each producer
+local disorder = 0
+
+skynet.start(function()
+	skynet.dispatch("text", function(_, source, msg)
+		if count == 0 then
+			start_time = skynet.now()
+		end
+		count = count + 1
+		-- the messages from one producer must keep their order
+		local seq = tonumber(msg)
+		if seq ~= (last[source] or 0) + 1 then
+			disorder = disorder + 1
+		end
+		last[source] = seq
+		if count == expect and done then
+			done(true, skynet.now() - start_time, disorder)
+		end
+	end)
+	skynet.dispatch("lua", function(_,_, n)
+		expect = n
+		done = skynet.response()
+		if count == expect then
+			done(true, skynet.now() - start_time, disorder)
+		end
+	end)
+end)
+
+elseif mode == "producer" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, hub, n)
+		for i = 1, n do
+			skynet.send(hub, "text", i)
+		end
+		skynet.ret()
+		skynet.exit()
+	end)
+end)
+
+else
+
+local TOTAL = 800000
+
+local function bench(producer)
+	local hub = skynet.newservice(SERVICE_NAME, "hub")
+	local n = TOTAL // producer
+	local list = {}
+	for i = 1, producer do
+		list[i] = skynet.newservice(SERVICE_NAME, "producer")
+	end
+	for i = 1, producer do
+		skynet.fork(skynet.call, list[i], "lua", hub, n)
+	end
+	local ti, disorder = skynet.call(hub, "lua", n * producer)
+	skynet.kill(hub)
+	assert(disorder == 0, "the messages are out of order")
+	skynet.error(string.format("producer %2d : %d messages in %.2fs, %.0f msg/s",
+		producer, n * producer, ti / 100, n * producer * 100 / ti))
+end
+
+skynet.start(function()
+	for _, producer in ipairs { 1, 2, 4, 8, 16 } do
+		bench(producer)
+	end
+	skynet.exit()
+end)
+
+end
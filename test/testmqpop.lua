@@ -0,0 +1,50 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- Fill the queue of a blocked consumer, then measure how fast one worker drains it.
+-- It shows the dispatch rate of one worker, without the cost of producers.
+
+local mode = ...
+
+if mode == "consumer" then
+
+local count = 0
+local expect
+local start_time
+local done
+
+skynet.start(function()
+	skynet.dispatch("lua", function(session, _, n)
+		if session == 0 then
+			count = count + 1
+			if count == expect then
+				done(true, skynet.now() - start_time)
+			end
+			return
+		end
+		-- block the consumer until the producer finishes
+		repeat until skynet.mqlen() >= n
+		expect = n
+		start_time = skynet.now()
+		done = skynet.response()
+	end)
+end)
+
+else
+
+local N = 1000000
+
+skynet.start(function()
+	local consumer = skynet.newservice(SERVICE_NAME, "consumer")
+	skynet.fork(function()
+		for i = 1, N do
+			skynet.send(consumer, "lua")
+		end
+	end)
+	local ti = skynet.call(consumer, "lua", N)
+	skynet.error(string.format("dispatch %d messages in %.2fs, %.0f msg/s per worker", N, ti / 100, N * 100 / ti))
+	skynet.kill(consumer)
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,59 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.name, skynet.kill
+
+-- Send by local name, the name lookup is cached in each thread until the names change.
+-- A service with many names is killed, all of its names are removed.
+
+local mode = ...
+
+local NAMES = 1000
+
+if mode == "echo" then
+
+local count = 0
+
+skynet.start(function()
+	skynet.dispatch("lua", function(session)
+		if session == 0 then
+			count = count + 1
+		else
+			skynet.ret(skynet.pack(count))
+		end
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local echo = skynet.newservice(SERVICE_NAME, "echo")
+	for i = 1, NAMES do
+		skynet.name(".echo" .. i, echo)
+	end
+	assert(skynet.localname ".echo1" == echo)
+	assert(skynet.localname ".nothing" == nil)
+
+	local N = 200000
+	local start = skynet.now()
+	for i = 1, N do
+		skynet.send(".echo1", "lua")
+	end
+	assert(skynet.call(echo, "lua") == N)
+	local ti = skynet.now() - start
+	skynet.error(string.format("send by name : %.0f msg/s", N * 100 / ti))
+
+	start = skynet.now()
+	skynet.kill(echo)
+	for i = 1, NAMES do
+		assert(skynet.localname(".echo" .. i) == nil)
+	end
+	-- the names can be used again
+	local echo2 = skynet.newservice(SERVICE_NAME, "echo")
+	skynet.name(".echo1", echo2)
+	assert(skynet.localname ".echo1" == echo2)
+	skynet.kill(echo2)
+	assert(skynet.localname ".echo1" == nil)
+	skynet.error(string.format("%d names removed in %dcs", NAMES, skynet.now() - start))
+	skynet.exit()
+end)
+
+end
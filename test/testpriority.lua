@@ -0,0 +1,98 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- Batch services flood their queues while an interactive service is called periodically,
+-- the round trip of the interactive service should stay flat.
+
+local mode = ...
+
+-- The flooding p99 may be k times of the idle p99 (at least 1cs) at most.
+local K = 10
+
+if mode == "batch" then
+
+skynet.start(function()
+	skynet.priority "batch"
+	skynet.dispatch("lua", function()
+		local s = 0
+		for i = 1, 1000 do
+			s = s + i
+		end
+	end)
+end)
+
+elseif mode == "flood" then
+
+-- The flooding is in its own service, so the main service is free to call the interactive one.
+local flooding = true
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, batch)
+		if batch == nil then
+			flooding = false
+			skynet.ret()
+			return
+		end
+		skynet.fork(function()
+			while flooding do
+				for i = 1, #batch do
+					for j = 1, 2000 do
+						skynet.send(batch[i], "lua")
+					end
+				end
+				skynet.sleep(1)
+			end
+		end)
+		skynet.ret()
+	end)
+end)
+
+elseif mode == "interactive" then
+
+skynet.start(function()
+	skynet.priority "interactive"
+	skynet.dispatch("lua", function()
+		skynet.ret()
+	end)
+end)
+
+else
+
+local function echo_time(echo, n)
+	local times = {}
+	for i = 1, n do
+		local t = skynet.now()
+		skynet.call(echo, "lua")
+		times[i] = skynet.now() - t
+		skynet.sleep(1)
+	end
+	table.sort(times)
+	return times[n // 2], times[n - n // 100]
+end
+
+skynet.start(function()
+	skynet.priority "interactive"
+	local echo = skynet.newservice(SERVICE_NAME, "interactive")
+	local p50, p99 = echo_time(echo, 100)
+	skynet.error(string.format("idle : p50 %dcs p99 %dcs", p50, p99))
+	local idle_p99 = p99
+
+	local batch = {}
+	for i = 1, 16 do
+		batch[i] = skynet.newservice(SERVICE_NAME, "batch")
+	end
+	local flood = skynet.newservice(SERVICE_NAME, "flood")
+	skynet.call(flood, "lua", batch)
+	p50, p99 = echo_time(echo, 100)
+	skynet.call(flood, "lua")
+	skynet.error(string.format("batch flooding : p50 %dcs p99 %dcs", p50, p99))
+	assert(p99 <= math.max(idle_p99, 1) * K, "the interactive service is delayed by the batch services")
+	skynet.kill(flood)
+	for i = 1, #batch do
+		skynet.kill(batch[i])
+	end
+	skynet.kill(echo)
+	skynet.exit()
+end)
+
+end
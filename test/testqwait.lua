@@ -0,0 +1,36 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- The messages wait in the queue while the service is busy, QWAIT tells it apart from the handler cost.
+
+local mode = ...
+
+if mode == "slow" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, ti)
+		local t = skynet.now()
+		while skynet.now() - t < ti do end
+		skynet.ret()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local slow = skynet.newservice(SERVICE_NAME, "slow")
+	for i = 1, 10 do
+		skynet.fork(skynet.call, slow, "lua", 2)
+	end
+	skynet.sleep(50)
+	local stat = skynet.call(slow, "debug", "QWAIT")
+	skynet.error(string.format("slow : count %d, p50 %dus, p99 %dus, max %dus", stat.count, stat.p50, stat.p99, stat.max))
+	-- the last one waits for the 9 before it (more than 1cs each), whether they are popped at once or not
+	assert(stat.max >= 65536)
+	local count, p50, p99, max = skynet.qwait "node"
+	skynet.error(string.format("node : count %d, p50 %dus, p99 %dus, max %dus", count, p50, p99, max))
+	skynet.kill(slow)
+	skynet.exit()
+end)
+
+end
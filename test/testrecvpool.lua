@@ -0,0 +1,58 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+-- Many small packets over a few connections, the receive buffers of socket thread are reused from the pool.
+-- It shows the malloc count and the reuse count of receive buffers.
+
+local PORT = 8004
+local CONN = 4
+local ROUND = 5000
+local MSG = string.rep("x", 99) .. "\n"
+
+local function echo(id)
+	socket.start(id)
+	while true do
+		local line = socket.readline(id)
+		if not line then
+			break
+		end
+		socket.write(id, line .. "\n")
+	end
+	socket.close(id)
+end
+
+skynet.start(function()
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id)
+		skynet.fork(echo, id)
+	end)
+	local ids = {}
+	for i = 1, CONN do
+		ids[i] = assert(socket.open("127.0.0.1", PORT))
+	end
+
+	local alloc0, reuse0 = socket.bufferstat()
+	local start = skynet.now()
+	for r = 1, ROUND do
+		for i = 1, CONN do
+			socket.write(ids[i], MSG)
+		end
+		for i = 1, CONN do
+			local line = assert(socket.readline(ids[i]))
+			assert(#line == #MSG - 1)
+		end
+	end
+	local ti = skynet.now() - start
+	local alloc, reuse, cached = socket.bufferstat()
+	alloc = alloc - alloc0
+	reuse = reuse - reuse0
+	assert(reuse > alloc, "receive buffers are not reused")
+	skynet.error(string.format("%d packets in %.2fs : malloc %d, reuse %d (%.1f%%), cached %d bytes",
+		ROUND * CONN * 2, ti / 100, alloc, reuse, reuse * 100 / (alloc + reuse), cached))
+
+	for i = 1, CONN do
+		socket.close(ids[i])
+	end
+	socket.close(listen_id)
+	skynet.exit()
+end)
@@ -0,0 +1,91 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- Independent ping-pong pairs keep every worker busy, it shows how the scheduler scales with worker threads.
+-- Run it with thread = 8, 16 and 32 in config to compare.
+
+local mode = ...
+
+-- The ping and pong messages are sent (session 0), the calls come from the main service.
+
+if mode == "pong" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_, source, seq)
+		skynet.send(source, "lua", seq)
+	end)
+end)
+
+elseif mode == "ping" then
+
+local n
+local seq = 0
+local lost = 0
+local done
+
+skynet.start(function()
+	skynet.dispatch("lua", function(session, source, ...)
+		if session == 0 then
+			-- pong returns what ping sent
+			if ... ~= seq then
+				lost = lost + 1
+			end
+			n = n - 1
+			if n > 0 then
+				seq = seq + 1
+				skynet.send(source, "lua", seq)
+			else
+				done(true, lost)
+			end
+		else
+			local pong, count = ...
+			n = count
+			done = skynet.response()
+			skynet.send(pong, "lua", seq)
+		end
+	end)
+end)
+
+else
+
+local ROUND = 20000
+
+local function bench(npair)
+	local ping, pong = {}, {}
+	for i = 1, npair do
+		ping[i] = skynet.newservice(SERVICE_NAME, "ping")
+		pong[i] = skynet.newservice(SERVICE_NAME, "pong")
+	end
+	local start = skynet.now()
+	local finish = 0
+	local co = coroutine.running()
+	for i = 1, npair do
+		skynet.fork(function()
+			local lost = skynet.call(ping[i], "lua", pong[i], ROUND)
+			assert(lost == 0, "pong returns a wrong message")
+			finish = finish + 1
+			if finish == npair then
+				skynet.wakeup(co)
+			end
+		end)
+	end
+	skynet.wait()
+	local ti = skynet.now() - start
+	for i = 1, npair do
+		skynet.kill(ping[i])
+		skynet.kill(pong[i])
+	end
+	local total = npair * ROUND * 2
+	skynet.error(string.format("pairs %3d : %d messages in %.2fs, %.0f msg/s",
+		npair, total, ti / 100, total * 100 / ti))
+end
+
+skynet.start(function()
+	skynet.error("worker thread : " .. skynet.getenv "thread")
+	for _, npair in ipairs { 1, 2, 4, 8, 16, 32, 64 } do
+		bench(npair)
+	end
+	skynet.exit()
+end)
+
+end
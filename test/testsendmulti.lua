@@ -0,0 +1,87 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- Broadcast to the members of a room with skynet.send_multi, the members share one payload.
+-- Compare with skynet.send to each member.
+-- A member in forward mode (skynet.forward_type) keeps the message, it gets its own copy.
+
+local mode = ...
+
+local MEMBER = 100
+local ROUND = 1000
+
+if mode == "member" or mode == "forward" then
+
+local count = 0
+local bytes = 0
+
+local function start()
+	skynet.dispatch("lua", function(_,_, cmd, msg)
+		if cmd == "chat" then
+			count = count + 1
+			bytes = bytes + #msg
+		else
+			skynet.ret(skynet.pack(count, bytes))
+			count = 0
+			bytes = 0
+		end
+	end)
+end
+
+if mode == "forward" then
+	-- no type is forwarded, the messages are dispatched and then trashed by forward_type
+	skynet.forward_type({}, start)
+else
+	skynet.start(start)
+end
+
+else
+
+local function check(room, expect_count, expect_bytes)
+	for _, addr in ipairs(room) do
+		local count, bytes = skynet.call(addr, "lua", "stat")
+		assert(count == expect_count and bytes == expect_bytes, string.format("%x : %d %d", addr, count, bytes))
+	end
+end
+
+skynet.start(function()
+	local room = {}
+	for i = 1, MEMBER do
+		room[i] = skynet.newservice(SERVICE_NAME, i % 10 == 0 and "forward" or "member")
+	end
+	local msg = string.rep("x", 256)
+
+	local start = skynet.now()
+	for i = 1, ROUND do
+		assert(skynet.send_multi(room, "lua", "chat", msg) == MEMBER)
+	end
+	check(room, ROUND, ROUND * #msg)
+	local multi = skynet.now() - start
+
+	start = skynet.now()
+	for i = 1, ROUND do
+		for _, addr in ipairs(room) do
+			skynet.send(addr, "lua", "chat", msg)
+		end
+	end
+	check(room, ROUND, ROUND * #msg)
+	local single = skynet.now() - start
+
+	-- the dead ones are skipped
+	local dead = table.remove(room)
+	skynet.kill(dead)
+	room[#room+1] = 0
+	assert(skynet.send_multi(room, "lua", "chat", msg) == MEMBER - 1)
+	room[#room] = nil
+	check(room, 1, #msg)
+
+	assert(not pcall(skynet.send_multi, { room[1], "invalid" }, "lua", "chat", msg))
+
+	skynet.error(string.format("%d members, %d rounds : send_multi %.2fs, send %.2fs", MEMBER, ROUND, multi / 100, single / 100))
+	for _, addr in ipairs(room) do
+		skynet.kill(addr)
+	end
+	skynet.exit()
+end)
+
+end
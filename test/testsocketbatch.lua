@@ -0,0 +1,89 @@
+local skynet = require "skynet"
+
+-- Many connections send small packages to a gate (snax.gateserver), with and without conf.batch.
+-- It shows the cpu time and the number of messages of the gate per package.
+
+local mode = ...
+
+local CONN = 200
+local ROUND = 100
+local MSG = string.pack(">s2", string.rep("x", 30))
+
+if mode == "gate" then
+
+local gateserver = require "snax.gateserver"
+
+local count = 0
+
+local handler = {}
+
+function handler.connect(fd)
+	gateserver.openclient(fd)
+end
+
+function handler.message(fd, msg, sz)
+	count = count + 1
+	skynet.trash(msg, sz)
+end
+
+function handler.command(cmd)
+	assert(cmd == "stat")
+	return count, skynet.stat "cpu", skynet.stat "message"
+end
+
+gateserver.start(handler)
+
+elseif mode == "client" then
+
+local socket = require "skynet.socket"
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, port)
+		local ids = {}
+		for i = 1, CONN do
+			ids[i] = assert(socket.open("127.0.0.1", port))
+		end
+		for r = 1, ROUND do
+			for i = 1, CONN do
+				socket.write(ids[i], MSG)
+			end
+			skynet.sleep(1)
+		end
+		skynet.ret()
+		skynet.sleep(10)
+		for i = 1, CONN do
+			socket.close(ids[i])
+		end
+		skynet.exit()
+	end)
+end)
+
+else
+
+local function bench(port, batch)
+	local gate = skynet.newservice(SERVICE_NAME, "gate")
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = port, batch = batch, maxclient = CONN })
+	local client = skynet.newservice(SERVICE_NAME, "client")
+	local _, cpu0, message0 = skynet.call(gate, "lua", "stat")
+	skynet.call(client, "lua", port)
+	local total = CONN * ROUND
+	local count, cpu, message
+	repeat
+		skynet.sleep(10)
+		count, cpu, message = skynet.call(gate, "lua", "stat")
+	until count >= total
+	assert(count == total, count)
+	cpu = cpu - cpu0
+	message = message - message0
+	skynet.error(string.format("batch %-5s : %d packages, gate cpu %.2f us per package, %.3f messages per package",
+		tostring(batch), total, cpu * 1000000 / total, message / total))
+	skynet.send(gate, "lua", "close")
+end
+
+skynet.start(function()
+	bench(8006, false)
+	bench(8007, true)
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,58 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+-- Ping-pong over one connection, it shows the round trip time of the socket thread.
+-- Build with -DUSE_IO_URING to compare the io_uring backend with epoll (testsocketshard for the throughput).
+
+local mode = ...
+
+local PORT = 8005
+local ROUND = 20000
+local MSG = string.rep("x", 63) .. "\n"
+
+if mode == "server" then
+
+local function echo(id)
+	socket.start(id)
+	while true do
+		local line = socket.readline(id)
+		if not line then
+			break
+		end
+		socket.write(id, line .. "\n")
+	end
+	socket.close(id)
+end
+
+skynet.start(function()
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id)
+		skynet.fork(echo, id)
+	end)
+	skynet.dispatch("lua", function()
+		socket.close(listen_id)
+		skynet.ret()
+		skynet.exit()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local server = skynet.newservice(SERVICE_NAME, "server")
+	local id = assert(socket.open("127.0.0.1", PORT))
+	local start = skynet.now()
+	for i = 1, ROUND do
+		socket.write(id, MSG)
+		local line = assert(socket.readline(id))
+		assert(#line == #MSG - 1)
+	end
+	local ti = skynet.now() - start
+	skynet.error(string.format("%d round trips in %.2fs, %.1f us per round trip",
+		ROUND, ti / 100, ti * 10000 / ROUND))
+	socket.close(id)
+	skynet.call(server, "lua")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,95 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+-- Echo over many connections, run it with socket_thread = 1, 4 (and socket_reuseport = true) in config to compare.
+-- After the listen socket is closed, no connection can be made (the sibling listen sockets are closed too).
+
+local mode, arg = ...
+
+local PORT = 8002
+local CLIENT = 8
+local CONN = 50	-- connections per client
+local ROUND = 200
+local MSG = string.rep("x", 1023) .. "\n"
+
+if mode == "client" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		local ids = {}
+		for i = 1, CONN do
+			ids[i] = assert(socket.open("127.0.0.1", PORT))
+		end
+		local bytes = 0
+		for r = 1, ROUND do
+			for i = 1, CONN do
+				socket.write(ids[i], MSG)
+			end
+			for i = 1, CONN do
+				local line = assert(socket.readline(ids[i]))
+				assert(#line == #MSG - 1)
+				bytes = bytes + #MSG
+			end
+		end
+		for i = 1, CONN do
+			socket.close(ids[i])
+		end
+		skynet.ret(skynet.pack(bytes))
+	end)
+end)
+
+else
+
+local function echo(id)
+	socket.start(id)
+	while true do
+		local line = socket.readline(id)
+		if not line then
+			break
+		end
+		socket.write(id, line .. "\n")
+	end
+	socket.close(id)
+end
+
+skynet.start(function()
+	local accepted = 0
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id, addr)
+		accepted = accepted + 1
+		skynet.fork(echo, id)
+	end)
+	local clients = {}
+	for i = 1, CLIENT do
+		clients[i] = skynet.newservice(SERVICE_NAME, "client")
+	end
+	local start = skynet.now()
+	local total = 0
+	local co = coroutine.running()
+	local finish = 0
+	for i = 1, CLIENT do
+		skynet.fork(function()
+			total = total + skynet.call(clients[i], "lua")
+			finish = finish + 1
+			if finish == CLIENT then
+				skynet.wakeup(co)
+			end
+		end)
+	end
+	skynet.wait()
+	local ti = skynet.now() - start
+	assert(accepted == CLIENT * CONN, accepted)
+	skynet.error(string.format("socket_thread %s reuseport %s : %d connections, %d bytes in %.2fs, %.2f MB/s",
+		skynet.getenv "socket_thread" or "1", skynet.getenv "socket_reuseport" or "false",
+		accepted, total * 2, ti / 100, total * 2 * 100 / ti / 1024 / 1024))
+
+	socket.close(listen_id)
+	skynet.sleep(10)
+	for i = 1, 10 do
+		assert(socket.open("127.0.0.1", PORT) == nil, "connect after close")
+	end
+	skynet.error("listen socket closed")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,62 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.kill
+
+-- Many services set a lot of timers expiring at the same tick, the timer thread pushes them by service.
+-- The timeouts of one service are still called in the order they are set.
+
+local mode = ...
+
+local N = 20000
+
+if mode == "slave" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, ti)
+		local last = 0
+		local count = 0
+		local co = coroutine.running()
+		for i = 1, N do
+			skynet.timeout(ti, function()
+				assert(last == i - 1)
+				last = i
+				count = count + 1
+				if count == N then
+					skynet.wakeup(co)
+				end
+			end)
+		end
+		skynet.wait()
+		skynet.ret()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local slaves = {}
+	for i = 1, 8 do
+		slaves[i] = skynet.newservice(SERVICE_NAME, "slave")
+	end
+	for round = 1, 3 do
+		local t = skynet.now()
+		local done = 0
+		local co = coroutine.running()
+		for i = 1, #slaves do
+			skynet.fork(function()
+				skynet.call(slaves[i], "lua", 10)
+				done = done + 1
+				if done == #slaves then
+					skynet.wakeup(co)
+				end
+			end)
+		end
+		skynet.wait()
+		skynet.error(string.format("round %d : %d timers in %dcs", round, N * #slaves, skynet.now() - t))
+	end
+	for i = 1, #slaves do
+		skynet.kill(slaves[i])
+	end
+	skynet.exit()
+end)
+
+end
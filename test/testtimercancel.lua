@@ -0,0 +1,41 @@
+local skynet = require "skynet"
+
+-- Guard timers are cancelled before they expire, so they never come back as messages.
+
+local N = 100000
+
+skynet.start(function()
+	local fired = 0
+	local timer = {}
+	local message = skynet.stat "message"
+	local function f() fired = fired + 1 end
+	for i = 1, N do
+		timer[i] = skynet.timeout(1000, f)
+	end
+	for i = 1, N do
+		assert(skynet.canceltimer(timer[i]) == true)
+		assert(skynet.canceltimer(timer[i]) == false)	-- cancel twice
+	end
+	skynet.sleep(20)
+	-- only the sleep response is dispatched
+	local dispatched = skynet.stat "message" - message
+	skynet.error(string.format("cancel %d timers, fired %d, dispatched %d", N, fired, dispatched))
+	assert(fired == 0 and dispatched == 1)
+
+	-- cancel after it fired
+	local t = skynet.timeout(1, f)
+	skynet.sleep(5)
+	assert(fired == 1 and skynet.canceltimer(t) == false)
+
+	-- the response is in the queue when it's cancelled
+	t = skynet.timeout(0, f)
+	assert(skynet.canceltimer(t) == true)
+	skynet.sleep(5)
+	assert(fired == 1)
+
+	local done = false
+	skynet.timeout_ms(10, function() done = true end)
+	skynet.sleep(5)
+	assert(done)
+	skynet.exit()
+end)
@@ -0,0 +1,76 @@
+local skynet = require "skynet"
+local core = require "skynet.core"
+require "skynet.manager"	-- import skynet.kill
+
+-- Many agents with a heartbeat timer each, the services are spread over all the workers,
+-- so skynet_timeout is called from every worker thread at the same time.
+-- Default is 200k agents (20 services x 10000) with a 100ms (10cs) heartbeat, run it with : testtimerheavy [services] [agents]
+
+local mode, n = ...
+
+local INTERVAL = 10	-- centisecond
+local DURATION = 500
+
+if mode == "agent" then
+
+local beats = 0
+local late = 0
+local running = true
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, n)
+		if cmd == "start" then
+			for i = 1, n do
+				local expect = skynet.now() + INTERVAL
+				local function beat()
+					local now = skynet.now()
+					beats = beats + 1
+					late = late + now - expect
+					if running then
+						expect = now + INTERVAL
+						skynet.timeout(INTERVAL, beat)
+					end
+				end
+				skynet.timeout(INTERVAL, beat)
+			end
+			skynet.ret()
+		else	-- stop
+			running = false
+			skynet.ret(skynet.pack(beats, late))
+		end
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local services = tonumber(mode) or 20
+	local agents = tonumber(n) or 10000
+	local list = {}
+	for i = 1, services do
+		list[i] = skynet.newservice(SERVICE_NAME, "agent")
+	end
+	for i = 1, services do
+		skynet.call(list[i], "lua", "start", agents)
+	end
+	core.command "TIMERLAG"	-- reset max
+	skynet.sleep(DURATION)
+	local beats, late = 0, 0
+	for i = 1, services do
+		local b, l = skynet.call(list[i], "lua", "stop")
+		beats = beats + b
+		late = late + l
+	end
+	local lag = core.command "TIMERLAG"
+	local total = services * agents
+	skynet.error(string.format("agents %d, heartbeat %dms, worker thread %s", total, INTERVAL * 10, skynet.getenv "thread"))
+	skynet.error(string.format("%d beats/s (expect %d), late %.2fcs per beat, timer lag : %s",
+		beats * 100 // DURATION, total * 100 // INTERVAL, late / beats, lag))
+	skynet.sleep(INTERVAL * 2)
+	for i = 1, services do
+		skynet.kill(list[i])
+	end
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,28 @@
+local skynet = require "skynet"
+local core = require "skynet.core"
+
+-- Timers of different length expire in order even if the timer thread stalls.
+-- Stop the process for a few seconds (kill -STOP, and then kill -CONT) while it's running,
+-- the wheel jumps to now (timer_catchup = "jump") and the lag is reported.
+
+local N = 1000
+
+skynet.start(function()
+	local fired = {}
+	for i = 1, N do
+		skynet.timeout(i, function()
+			table.insert(fired, i)
+		end)
+	end
+	for i = 1, 6 do
+		skynet.sleep(200)
+		local last, max, stalls, jumps = core.command("TIMERLAG"):match "(%d+) (%d+) (%d+) (%d+)"
+		skynet.error(string.format("fired %d, lag %dus (max %dus), stalls %d, jumps %d", #fired, last, max, stalls, jumps))
+	end
+	skynet.sleep(10)
+	assert(#fired == N)
+	for i = 1, N do
+		assert(fired[i] == i)
+	end
+	skynet.exit()
+end)
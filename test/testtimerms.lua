@@ -0,0 +1,39 @@
+local skynet = require "skynet"
+
+-- Run it with timer_tick = 1 in config, sleep_ms(2) takes 2ms.
+-- With the default tick (10ms), it's rounded up to 10ms.
+
+local N = 100
+
+skynet.start(function()
+	local tick = tonumber(skynet.getenv "timer_tick") or 10
+	local expect = math.max(tick, 2) * N // 10	-- in centisecond
+
+	local t = skynet.now()
+	for i = 1, N do
+		skynet.sleep_ms(2)
+	end
+	t = skynet.now() - t
+	skynet.error(string.format("timer_tick %dms : %d x sleep_ms(2) takes %dcs, expect %dcs", tick, N, t, expect))
+	-- a timer never fires early, but it may be late on a loaded machine
+	assert(t >= expect)
+	if t > expect * 2 then
+		skynet.error("sleep_ms(2) is too late, the machine may be busy")
+	end
+
+	local done = false
+	skynet.timeout_ms(5, function() done = true end)
+	skynet.sleep(1)
+	assert(done or tick == 10)
+
+	-- centisecond api is not changed
+	t = skynet.now()
+	skynet.sleep(10)
+	t = skynet.now() - t
+	skynet.error(string.format("sleep(10) takes %dcs", t))
+	assert(t >= 10)
+	if t > 11 then
+		skynet.error("sleep(10) is too late, the machine may be busy")
+	end
+	skynet.exit()
+end)
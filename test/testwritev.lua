@@ -0,0 +1,73 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+-- Many small sends per tick to one connection, the socket thread flushes the queued buffers with writev.
+-- It shows the write syscalls (syscw in /proc/self/io, linux only) per message and the throughput.
+-- Each socket.lwrite costs one write of the ctrl pipe, so it's about 2 per message without writev.
+
+local PORT = 8003
+local ROUND = 2000
+local BATCH = 64	-- messages per tick
+local MSG = string.rep("x", 32)
+
+local function syscw()
+	local f = io.open "/proc/self/io"
+	if not f then
+		return 0
+	end
+	local s = f:read "a"
+	f:close()
+	return tonumber(s:match "syscw:%s*(%d+)") or 0
+end
+
+local function bench(name, write)
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	local conn
+	socket.start(listen_id, function(id)
+		conn = id
+	end)
+	local reader = assert(socket.open("127.0.0.1", PORT))
+	while not conn do
+		skynet.yield()
+	end
+	socket.close(listen_id)
+	socket.start(conn)
+
+	local total = ROUND * BATCH * #MSG
+	local co = coroutine.running()
+	local done
+	skynet.fork(function()
+		local bytes = 0
+		while bytes < total do
+			local s = assert(socket.read(reader))
+			bytes = bytes + #s
+		end
+		done = true
+		skynet.wakeup(co)
+	end)
+
+	local calls = syscw()
+	local start = skynet.now()
+	for r = 1, ROUND do
+		for i = 1, BATCH do
+			write(conn, MSG)
+		end
+		skynet.yield()
+	end
+	if not done then
+		skynet.wait()
+	end
+	local ti = skynet.now() - start
+	calls = syscw() - calls
+	local n = ROUND * BATCH
+	skynet.error(string.format("%-6s : %d messages in %.2fs, %.0f msg/s, %.2f MB/s, %.3f write syscalls per message",
+		name, n, ti / 100, n * 100 / ti, total * 100 / ti / 1024 / 1024, calls / n))
+	socket.close(reader)
+	socket.close(conn)
+end
+
+skynet.start(function()
+	bench("lwrite", socket.lwrite)
+	bench("write", socket.write)
+	skynet.exit()
+end)